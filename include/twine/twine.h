@@ -22,8 +22,12 @@
 
 #include <memory>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <optional>
+#include <span>
 #include <string>
+#include <vector>
 #include <functional>
 
 #ifdef TWINE_APPLE_THREADING
@@ -141,6 +145,53 @@ int rt_printf(const char *format, ...);
 
 typedef void (*WorkerCallback)(void* data);
 
+typedef void (*RangeCallback)(int begin, int end, void* data);
+
+/**
+ * @brief Information about the cycle a worker is running, see current_worker_context().
+ *        Times are in the same time base as current_rt_time().
+ */
+struct WorkerContext
+{
+    int worker_index{-1};                       // The id of the worker, see WorkerPool::add_worker()
+    uint64_t cycle{0};                          // The number of cycles started by the pool, including the current one
+    std::chrono::nanoseconds release_time{0};   // When the current cycle was started
+    std::chrono::nanoseconds deadline{0};       // When the current cycle should be finished, 0 if not set
+    int slot{0};                                // The buffer slot to process, see WorkerPool::wakeup_pipelined()
+};
+
+// Number of buffer slots the pipelined mode alternates between, see WorkerPool::wakeup_pipelined()
+constexpr int PIPELINE_SLOTS = 2;
+
+/**
+ * @brief Get the context of the worker calling the function, e.g. for indexing per
+ *        worker or per cycle data directly, or for skipping optional work when the
+ *        cycle's deadline is close. Safe to call from a realtime thread.
+ * @return A pointer to the context, valid for the lifetime of the worker, or nullptr
+ *         if not called from a worker thread.
+ */
+const WorkerContext* current_worker_context();
+
+/**
+ * @brief Check if the calling worker should give up the rest of its work in the current
+ *        cycle, e.g. skip optional processing, because the cycle's deadline is about to
+ *        pass or the cycle was cancelled with WorkerPool::cancel_cycle(). Does not lock
+ *        or make syscalls, so can be polled from a realtime thread.
+ * @param margin Also abort if less than margin remains until the deadline, e.g. the
+ *               expected duration of the work about to be started
+ * @return true if the work should be aborted, always false if not called from a worker
+ */
+bool should_abort(std::chrono::nanoseconds margin = std::chrono::nanoseconds(0));
+
+/**
+ * @brief Selects a set of workers in a pool, bit i selects the i:th worker added
+ */
+typedef uint64_t WorkerMask;
+
+constexpr WorkerMask ALL_WORKERS = ~WorkerMask(0);
+
+constexpr int MAX_WORKERS_PER_POOL = 64;
+
 enum class WorkerPoolStatus
 {
     OK,
@@ -161,12 +212,194 @@ enum class WorkerPoolStatus
  */
 std::chrono::nanoseconds current_rt_time();
 
+/**
+ * @brief A cpu core used by a WorkerPool. The topology fields identify the physical
+ *        core, caches, package and numa node of the cpu. Cpus with equal values share
+ *        that resource, -1 means the topology is unknown.
+ */
 struct CpuInfo
 {
     int id;
     int workers;
+    int core{-1};           // Shared by SMT siblings
+    int l2_cache{-1};
+    int l3_cache{-1};
+    int package{-1};
+    int numa_node{-1};
+};
+
+/**
+ * @brief Optional callbacks run by a worker on its own thread, with the same data
+ *        pointer as its worker callback. Useful for allocating and warming up per
+ *        worker state so that it is local to the worker's core and numa node.
+ */
+struct WorkerHooks
+{
+    WorkerCallback on_start{nullptr};   // Called before the worker first waits for work
+    WorkerCallback on_stop{nullptr};    // Called when the worker has stopped, right before its thread exits
+};
+
+/**
+ * @brief Scheduling parameters for a worker using the SCHED_DEADLINE policy. The
+ *        kernel guarantees the worker runtime of cpu time every period, to be
+ *        completed within deadline from the start of the period. Requires
+ *        runtime <= deadline <= period and a runtime of at least 1 us.
+ */
+struct DeadlineParameters
+{
+    std::chrono::nanoseconds runtime;
+    std::chrono::nanoseconds deadline;
+    std::chrono::nanoseconds period;
+};
+
+/**
+ * @brief Get deadline parameters for a worker that runs once every audio period
+ * @param chunk_size The number of samples processed every period
+ * @param sample_rate The sample rate in Hz
+ * @param budget The fraction of the period the worker is guaranteed, in (0, 1]
+ * @return DeadlineParameters with a deadline and period equal to the audio period
+ */
+DeadlineParameters deadline_parameters_for_audio_period(int chunk_size, float sample_rate, float budget);
+
+/**
+ * @brief The synchronisation mechanism used by a WorkerPool to release and wait for its workers
+ */
+enum class BarrierType
+{
+    MUTEX,      // Arrivals and releases are protected by a mutex and condition variable. Always wakes
+                // all workers, use LOCK_FREE or FUTEX for WorkerPool::wakeup_workers(WorkerMask)
+    LOCK_FREE,  // Arrivals are single atomic operations, locks are only taken for sleeping and waking the caller
+    FUTEX       // Linux only, workers are released with a single futex wake-up. Only available for posix threads,
+                // other configurations use LOCK_FREE instead
+};
+
+/**
+ * @brief How workers waiting to be released, and threads waiting for the workers
+ *        to finish, should wait
+ */
+enum class WaitPolicy
+{
+    BLOCK,              // Always sleep in the kernel until woken up
+    BUSY_POLL,          // Never sleep, only suitable when every worker has an isolated core to itself
+    SPIN_THEN_BLOCK     // Busy poll for at most WorkerPoolOptions::spin_time, then sleep
+};
+
+constexpr auto DEFAULT_SPIN_TIME = std::chrono::microseconds(20);
+
+constexpr auto DEFAULT_SYSFS_CPU_PATH = "/sys/devices/system/cpu";
+
+/**
+ * @brief Stack settings for the worker threads of a WorkerPool. Prefaulting and
+ *        locking the stack is done by each worker thread before it first waits
+ *        for work, so that the worker callback never takes page faults on its stack.
+ */
+struct WorkerStackOptions
+{
+    size_t size{0};             // Stack size in bytes, 0 for the system default
+    bool prefault{false};       // Touch every page of the stack
+    bool lock{false};           // Lock the stack in memory with mlock()
+    bool huge_pages{false};     // Allocate the stack on huge pages if available, Linux only
+};
+
+/**
+ * @brief Optional settings for WorkerPool construction
+ */
+struct WorkerPoolOptions
+{
+    BarrierType barrier_type{BarrierType::MUTEX};
+    WaitPolicy wait_policy{WaitPolicy::BLOCK};
+    std::chrono::nanoseconds spin_time{DEFAULT_SPIN_TIME};
+    bool record_timings{false};     // Record per worker timings, see WorkerPool::worker_timings()
+    std::string sysfs_cpu_path{DEFAULT_SYSFS_CPU_PATH};  // Where the cpu topology is read from
+    WorkerStackOptions stack;
+};
+
+/**
+ * @brief Counts of how waits in a WorkerPool ended. A wait that ended while spinning
+ *        did not need to sleep in the kernel.
+ */
+struct WaitStatistics
+{
+    uint64_t worker_spin_wakeups{0};
+    uint64_t worker_blocking_wakeups{0};
+    uint64_t caller_spin_wakeups{0};
+    uint64_t caller_blocking_wakeups{0};
+};
+
+/**
+ * @brief Summary of a set of recorded durations. Percentiles are accurate to
+ *        within about 6%. All fields are 0 if nothing has been recorded.
+ */
+struct TimingSummary
+{
+    uint64_t count{0};
+    std::chrono::nanoseconds min{0};
+    std::chrono::nanoseconds mean{0};
+    std::chrono::nanoseconds p99{0};
+    std::chrono::nanoseconds p999{0};
+    std::chrono::nanoseconds max{0};
+};
+
+/**
+ * @brief Timings recorded for every cycle of a single worker
+ */
+struct WorkerTimings
+{
+    TimingSummary wake_latency;         // From the workers being released until the worker started running
+    TimingSummary callback_duration;    // Time spent in the worker's callback, or the cycle's job
+    TimingSummary completion_skew;      // From the first worker finishing until this worker finished
+};
+
+/**
+ * @brief The result of waiting for the workers with a deadline, see WorkerPool::wait_until()
+ */
+enum class WaitResult
+{
+    IDLE,       // All workers have finished the cycle
+    TIMED_OUT   // The deadline passed before all workers had finished
+};
+
+/**
+ * @brief Points in a pool cycle that are traced if twine is built with TWINE_WITH_TRACING
+ */
+enum class TraceEvent : uint8_t
+{
+    BARRIER_EXIT,       // A worker was released from the barrier
+    CALLBACK_BEGIN,     // A worker started its callback, or the cycle's job
+    CALLBACK_END,       // A worker finished its callback
+    BARRIER_ARRIVAL,    // A worker arrived on the barrier
+    RELEASE,            // The calling thread released the workers
+    WAIT_BEGIN,         // The calling thread started waiting for the workers
+    WAIT_END            // All workers had arrived on the barrier
+};
+
+// Thread id of the records written by the thread calling into the pool
+constexpr int CALLER_TRACE_THREAD = -1;
+
+/**
+ * @brief A single traced event, see WorkerPool::drain_trace()
+ */
+struct TraceRecord
+{
+    std::chrono::nanoseconds time{0};   // As returned by current_rt_time()
+    TraceEvent event{TraceEvent::BARRIER_EXIT};
+    int thread{0};                      // The worker id, or CALLER_TRACE_THREAD
+    uint32_t value{0};                  // The cycle number for worker events, the number of workers released
+                                        // for RELEASE and 1 if the wait ended while spinning for WAIT_END
 };
 
+/**
+ * @brief Convert trace records to the Chrome trace event JSON format, which can be
+ *        opened in Perfetto (ui.perfetto.dev) or chrome://tracing. Every worker and
+ *        the calling thread are shown as separate threads, callbacks and the calling
+ *        thread waiting for the workers as slices and the other events as instants.
+ * @param records The records to convert, i.e. from WorkerPool::drain_trace()
+ * @return A complete JSON document
+ */
+[[nodiscard]] std::string to_chrome_trace_json(const std::vector<TraceRecord>& records);
+
+class RtConditionVariable;
+
 /**
  * @brief Worker Pool for running multiple realtime threads in parallel
  */
@@ -185,12 +418,14 @@ public:
      *                         thread, enabling debugging of memory allocations and syscalls from
      *                         an audio thread. Only enabled for xenomai threads. Argument has no
      *                         effect for posix threads.
+     * @param options Additional settings for the pool, see WorkerPoolOptions.
      * @return
      */
     [[nodiscard]] static std::unique_ptr<WorkerPool> create_worker_pool(int cores,
                                                                         [[maybe_unused]] apple::AppleMultiThreadData apple_data,
                                                                         bool disable_denormals = true,
-                                                                        bool break_on_mode_sw = false);
+                                                                        bool break_on_mode_sw = false,
+                                                                        const WorkerPoolOptions& options = WorkerPoolOptions());
 
     virtual ~WorkerPool() = default;
 
@@ -200,14 +435,73 @@ public:
      * @param worker_data A data pointer that will be passed to the worker callback
      * @param sched_priority Worker priority in [0, 100] (higher numbers mean higher priorities)
      * @param cpu_id Optional CPU core affinity preference. If left unspecified,
-     *               the first core with least usage is picked
+     *               the core with least usage is picked, avoiding cores whose
+     *               SMT siblings are busy and preferring cores that share caches
+     *               with the other workers
+     * @param hooks Optional callbacks for the worker to call on its own thread when it
+     *              starts and stops. on_start has returned by the time add_worker() returns.
+     *
+     *        Workers are identified by ids in [0, MAX_WORKERS_PER_POOL). A new worker
+     *        gets the lowest id not used by another worker, so unless workers have
+     *        been removed, the id of a worker is the number of workers added before it.
      *
-     * @return WorkerPoolStatus::OK if the operation succeed, error status otherwise
+     * @return WorkerPoolStatus::OK if the operation succeed, error status otherwise.
+     *         WorkerPoolStatus::LIMIT_EXCEEDED if the pool already has MAX_WORKERS_PER_POOL
+     *         workers.
      */
     [[nodiscard]] virtual std::pair<WorkerPoolStatus, apple::AppleThreadingStatus> add_worker(WorkerCallback worker_cb,
                                                                                               void* worker_data,
                                                                                               int sched_priority = DEFAULT_SCHED_PRIORITY,
-                                                                                              std::optional<int> cpu_id = std::nullopt) = 0;
+                                                                                              std::optional<int> cpu_id = std::nullopt,
+                                                                                              const WorkerHooks& hooks = WorkerHooks()) = 0;
+
+    /**
+     * @brief Add a worker that is scheduled with SCHED_DEADLINE instead of SCHED_FIFO, which
+     *        guarantees the worker a budget of cpu time every period and keeps a worker
+     *        that overruns its budget from starving other threads. Only supported for
+     *        posix threads on Linux. Deadline workers are not pinned to a core, as the
+     *        kernel only accepts deadline threads that may run on all cpus. Note that a
+     *        deadline worker that yields its cpu gives up the rest of its runtime for the
+     *        current period.
+     * @param worker_cb The worker callback function that will be called by the worker
+     * @param worker_data A data pointer that will be passed to the worker callback
+     * @param parameters The runtime, deadline and period of the worker,
+     *                   see deadline_parameters_for_audio_period()
+     * @param hooks Optional callbacks for the worker to call on its own thread, see add_worker()
+     * @return WorkerPoolStatus::OK if the operation succeed, error status otherwise.
+     *         WorkerPoolStatus::LIMIT_EXCEEDED if the kernel's admission control
+     *         refused to reserve the runtime, in which case no worker is added.
+     *         WorkerPoolStatus::INVALID_ARGUMENTS if the parameters are invalid or
+     *         the pool does not support deadline workers.
+     */
+    [[nodiscard]] virtual std::pair<WorkerPoolStatus, apple::AppleThreadingStatus> add_deadline_worker(WorkerCallback worker_cb,
+                                                                                                       void* worker_data,
+                                                                                                       const DeadlineParameters& parameters,
+                                                                                                       const WorkerHooks& hooks = WorkerHooks()) = 0;
+
+    /**
+     * @brief Remove a worker from the pool and stop its thread, without affecting the
+     *        other workers. Waits for the workers to become idle first, so the worker
+     *        is removed at a cycle boundary. Not safe to call from a realtime thread
+     *        or concurrently with waking up the workers.
+     * @param worker_id The id of the worker to remove, see add_worker()
+     * @return WorkerPoolStatus::OK if the worker was removed, WorkerPoolStatus::INVALID_ARGUMENTS
+     *         if there is no worker with that id
+     */
+    [[nodiscard]] virtual WorkerPoolStatus remove_worker(int worker_id) = 0;
+
+    /**
+     * @brief Replace the callback of a worker. Takes effect the next time the worker
+     *        is woken up, a worker that is currently running finishes its cycle with
+     *        the old callback. Safe to call from a realtime thread, but not concurrently
+     *        with adding or removing workers.
+     * @param worker_id The id of the worker, see add_worker()
+     * @param worker_cb The new worker callback function
+     * @param worker_data A data pointer that will be passed to the new callback
+     * @return WorkerPoolStatus::OK if successful, WorkerPoolStatus::INVALID_ARGUMENTS
+     *         if there is no worker with that id or worker_cb is null
+     */
+    [[nodiscard]] virtual WorkerPoolStatus set_worker_callback(int worker_id, WorkerCallback worker_cb, void* worker_data) = 0;
 
     /**
      * @brief Wait for all workers to finish and become idle. Will block until all
@@ -215,6 +509,38 @@ public:
      */
     virtual void wait_for_workers_idle() = 0;
 
+    /**
+     * @brief Check if all workers woken up have finished the cycle, without blocking
+     *        or finishing the cycle. Safe to call from a realtime thread.
+     */
+    [[nodiscard]] virtual bool is_idle() const = 0;
+
+    /**
+     * @brief Non-blocking version of wait_for_workers_idle(). Lets the calling thread
+     *        do other work while the workers are running and poll for them to finish.
+     * @return true if the workers were idle, which finishes the cycle as
+     *         wait_for_workers_idle() would, false if any worker is still running
+     */
+    [[nodiscard]] virtual bool try_wait() = 0;
+
+    /**
+     * @brief Wait for the workers to become idle, but no longer than until deadline.
+     *        After a timeout the cycle is still running, i.e. the calling thread can
+     *        output silence for the current period. The workers must then be waited for
+     *        again with any of the wait functions before they are woken up again.
+     * @param deadline In the time base of current_rt_time()
+     * @return WaitResult::IDLE if all workers had finished, WaitResult::TIMED_OUT otherwise,
+     *         see running_workers() for which workers were still running
+     */
+    [[nodiscard]] virtual WaitResult wait_until(std::chrono::nanoseconds deadline) = 0;
+
+    /**
+     * @brief Get the workers that were woken up and have not finished their callbacks
+     *        in the current cycle. Only safe to call from the thread waking up the workers.
+     * @return Bit i is set if the worker with id i is still running
+     */
+    [[nodiscard]] virtual WorkerMask running_workers() const = 0;
+
     /**
      * @brief Signal all workers to run call their respective callback functions in
      *        an unspecified order. The call will not block until all workers have finished.
@@ -229,10 +555,191 @@ public:
     virtual void wakeup_and_wait() = 0;
 
     /**
-     * @brief Get a list of Cpu cores used by twine with their ids and the number of workers assigned to them
+     * @brief Signal only the workers selected by mask to call their callback functions.
+     *        Unselected workers only stay asleep in pools created with BarrierType::LOCK_FREE
+     *        or BarrierType::FUTEX. With BarrierType::MUTEX, the default, they wake up and
+     *        synchronise with the pool, but return to idle without calling their callbacks.
+     *        The call will not block until the workers have finished.
+     * @param mask Bit i selects the i:th worker added to the pool
+     */
+    virtual void wakeup_workers(WorkerMask mask) = 0;
+
+    /**
+     * @brief Signal only the workers selected by mask to call their callback functions
+     *        and block until they have finished. See wakeup_workers(WorkerMask).
+     * @param mask Bit i selects the i:th worker added to the pool
+     */
+    virtual void wakeup_and_wait(WorkerMask mask) = 0;
+
+    /**
+     * @brief Signal the workers to call their callback functions with data pointers for
+     *        this cycle only, instead of the ones given to add_worker(). The pointers are
+     *        not copied, they are published to the workers along with the wakeup, so
+     *        worker_data must stay valid until the workers are idle again. The call will
+     *        not block until the workers have finished.
+     * @param worker_data Element i is passed to the callback of the worker with id i.
+     *                    Workers with ids beyond its end get their usual data pointer.
+     */
+    virtual void wakeup_workers(std::span<void* const> worker_data) = 0;
+
+    /**
+     * @brief Signal the workers to call their callback functions with data pointers for
+     *        this cycle only and block until they have finished.
+     *        See wakeup_workers(std::span<void* const>).
+     * @param worker_data Element i is passed to the callback of the worker with id i
+     */
+    virtual void wakeup_and_wait(std::span<void* const> worker_data) = 0;
+
+    /**
+     * @brief Run the workers one period behind the calling thread, for processing that
+     *        can tolerate one period of latency. Waits for the cycle started by the
+     *        previous call to finish, if there is one, then starts a new cycle without
+     *        waiting for it. This way the workers can use close to a whole period, while
+     *        the calling thread delivers the previous output and prepares the next input.
+     *
+     *        Buffers are kept in PIPELINE_SLOTS slots that the calling thread and the
+     *        workers take turns owning. The calling thread owns slot 0 before the first
+     *        call, and every call hands the slot owned by the calling thread to the
+     *        workers, who get it from WorkerContext::slot. The worker callbacks are called
+     *        with the data given to add_worker(). Must not be mixed with the other wakeup
+     *        functions until finish_pipeline() has been called.
+     * @return The slot the calling thread owns until the next call. Except after the first
+     *         call, it holds the output of the cycle that just finished, and it should be
+     *         filled with the input of the next cycle once the output has been delivered.
+     */
+    [[nodiscard]] virtual int wakeup_pipelined() = 0;
+
+    /**
+     * @brief Wait for the cycle started by the last call to wakeup_pipelined() and leave
+     *        the pipelined mode. The next call to wakeup_pipelined() starts a new pipeline,
+     *        with the calling thread owning slot 0.
+     * @return The slot holding the output of that cycle, or -1 if no cycle was running
+     */
+    virtual int finish_pipeline() = 0;
+
+    /**
+     * @brief Set a callback that the calling thread runs in wakeup_and_wait() after
+     *        waking up the workers and before waiting for them, so that the calling
+     *        thread does useful work in parallel with the workers instead of just
+     *        sleeping. Typically used for the work of one worker less than otherwise
+     *        needed. Not called by wakeup_workers(). Must not be called concurrently
+     *        with wakeup_and_wait().
+     * @param caller_cb The callback function, or nullptr to not run any callback
+     * @param caller_data A data pointer that will be passed to the callback
+     */
+    virtual void set_caller_callback(WorkerCallback caller_cb, void* caller_data) = 0;
+
+    /**
+     * @brief Set the deadline of the next cycle started, which workers can read through
+     *        current_worker_context() and should_abort(). Workers finishing after the
+     *        deadline are counted as overruns, see worker_overruns(). Only applies to one
+     *        cycle, so should be called before every wakeup. Safe to call from a realtime
+     *        thread, but not concurrently with waking up the workers.
+     * @param deadline The deadline in the time base of current_rt_time()
+     */
+    virtual void set_cycle_deadline(std::chrono::nanoseconds deadline) = 0;
+
+    /**
+     * @brief Ask the workers to abort the cycle that is currently running, which they see
+     *        through should_abort(). Workers are not interrupted, they have to poll for it.
+     *        Typically called when wait_until() times out. Only applies to the current
+     *        cycle. Safe to call from a realtime thread.
+     */
+    virtual void cancel_cycle() = 0;
+
+    /**
+     * @brief Notify a non realtime thread when a worker finishes a cycle too late. Workers
+     *        notify cond_var right after their callback if they finish more than threshold
+     *        after the cycle's deadline, the waiting thread can then check worker_overruns().
+     *        Must only be called while the workers are idle.
+     * @param cond_var The condition variable to notify, or nullptr to disable notifications.
+     *                 Must outlive the pool or be removed before it is destroyed.
+     * @param threshold How late a worker must finish to cause a notification
+     */
+    virtual void set_overrun_notification(RtConditionVariable* cond_var, std::chrono::nanoseconds threshold) = 0;
+
+    /**
+     * @brief Get a list of Cpu cores used by twine with their ids, topology and the
+     *        number of workers assigned to them
      */
     [[nodiscard]] virtual std::vector<CpuInfo> core_info() const = 0;
 
+    /**
+     * @brief Get statistics on how often the spin phase of the pool's WaitPolicy was
+     *        sufficient. Safe to call from any thread, counts are updated without locking.
+     */
+    [[nodiscard]] virtual WaitStatistics wait_statistics() const = 0;
+
+    /**
+     * @brief Get summaries of the timings recorded for each worker, indexed by worker id.
+     *        Ids without a worker get empty summaries, as do all workers if the pool was created
+     *        with WorkerPoolOptions::record_timings disabled. Not safe to call from a
+     *        realtime thread, but does not lock or otherwise interfere with the workers.
+     */
+    [[nodiscard]] virtual std::vector<WorkerTimings> worker_timings() const = 0;
+
+    /**
+     * @brief Get the number of cycles each worker finished after the cycle's deadline,
+     *        see set_cycle_deadline(). Indexed by worker id, ids without a worker get 0.
+     *        Safe to call from any thread, counts are updated without locking.
+     */
+    [[nodiscard]] virtual std::vector<uint64_t> worker_overruns() const = 0;
+
+    /**
+     * @brief Collect the trace records written by the workers and the calling thread
+     *        since the last call, sorted by time. Records are only written if twine is
+     *        built with TWINE_WITH_TRACING, otherwise nothing is returned. Every thread
+     *        keeps a fixed number of its latest records, so older records are lost if
+     *        the trace is not drained often enough. Not safe to call from a realtime
+     *        thread or concurrently with adding or removing workers, but does not lock
+     *        or otherwise interfere with the workers.
+     */
+    [[nodiscard]] virtual std::vector<TraceRecord> drain_trace() = 0;
+
+    /**
+     * @brief Add a job to the pool's job graph. Jobs declare the jobs they depend on and
+     *        are started by the first free worker as soon as all those have finished.
+     *        Not safe to call concurrently with run_job_graph().
+     * @param job_cb The callback function that will be called when the job is run
+     * @param job_data A data pointer that will be passed to the job callback
+     * @param predecessors The ids of the jobs that must finish before this job can start.
+     *                     Only jobs that have already been added can be referenced.
+     *
+     * @return WorkerPoolStatus::OK and the id of the new job if the operation succeed,
+     *         error status and -1 otherwise
+     */
+    [[nodiscard]] virtual std::pair<WorkerPoolStatus, int> add_job(WorkerCallback job_cb,
+                                                                   void* job_data,
+                                                                   const std::vector<int>& predecessors = {}) = 0;
+
+    /**
+     * @brief Remove all jobs from the job graph. Not safe to call concurrently with
+     *        run_job_graph().
+     */
+    virtual void clear_jobs() = 0;
+
+    /**
+     * @brief Signal all workers to run the job graph and block until all jobs have finished.
+     *        The calling thread also runs jobs while waiting. The workers' own callbacks
+     *        are not called when running the job graph.
+     */
+    virtual void run_job_graph() = 0;
+
+    /**
+     * @brief Run fn over the range [begin, end) in chunks of at most grain indices,
+     *        using all workers and the calling thread. Chunks are spread evenly at
+     *        the start and idle threads then steal chunks from busy ones, so uneven
+     *        work is balanced automatically. Blocks until all chunks have finished.
+     *        The workers' own callbacks are not called when running the range.
+     *        Nothing is run if the range is empty or grain is not positive.
+     * @param begin The first index of the range
+     * @param end One past the last index of the range
+     * @param grain The maximum number of indices passed to each call of fn, must be > 0
+     * @param fn The function called with the begin and end indices of each chunk
+     * @param data A data pointer that will be passed to fn
+     */
+    virtual void parallel_for(int begin, int end, int grain, RangeCallback fn, void* data) = 0;
+
 protected:
     WorkerPool() = default;
 };
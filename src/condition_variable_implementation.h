@@ -99,12 +99,26 @@ public:
     bool wait() override;
 
 private:
+#ifdef __APPLE__
     std::string   _name;
+#else
+    sem_t         _unnamed_semaphore;
+#endif
     sem_t*        _semaphore;
 };
 
 PosixSemaphoreConditionVariable::PosixSemaphoreConditionVariable() : _semaphore(nullptr)
 {
+#ifndef __APPLE__
+    // Process private, so no name is needed and nothing is created in the file system
+    if (sem_init(&_unnamed_semaphore, 0, 0) != 0)
+    {
+        auto err_str = std::string("Failed to initialize RtConditionVariable, ") + strerror(errno);
+        throw std::runtime_error(err_str.c_str());
+    }
+    _semaphore = &_unnamed_semaphore;
+#else
+    // macOS only supports named semaphores
     int retries = MAX_RETRIES;
     std::srand(static_cast<unsigned int>(std::time(nullptr)));
 
@@ -126,6 +140,7 @@ PosixSemaphoreConditionVariable::PosixSemaphoreConditionVariable() : _semaphore(
         return;
     }
     throw std::runtime_error("Failed to initialize RtConditionVariable, no more retries.");
+#endif
 }
 
 PosixSemaphoreConditionVariable::~PosixSemaphoreConditionVariable()
@@ -133,7 +148,12 @@ PosixSemaphoreConditionVariable::~PosixSemaphoreConditionVariable()
     if (_semaphore)
     {
         this->notify();
+#ifdef __APPLE__
+        sem_close(_semaphore);
         sem_unlink(_name.c_str());
+#else
+        sem_destroy(_semaphore);
+#endif
     }
 }
 
@@ -313,8 +333,6 @@ void XenomaiConditionVariable::_set_up_files()
 
 using MsgType = uint8_t;
 constexpr size_t XBUF_SIZE = 1024;
-// since std::hardware_destructive_interference_size is not yet supported in GCC 11
-constexpr int ASSUMED_CACHE_LINE_SIZE = 64;
 
 constexpr auto EVL_COND_VAR_WAIT_TIMEOUT = std::chrono::milliseconds(1000);
 constexpr int  EVL_SHUTDOWN_RETRIES = 10;
@@ -337,7 +355,7 @@ private:
     int  _xbuf_to_rt{0};
     int  _xbuf_to_nonrt{0};
     int  _id{0};
-    alignas(ASSUMED_CACHE_LINE_SIZE) std::atomic_bool _is_waiting{false};
+    alignas(CACHE_LINE_SIZE) std::atomic_bool _is_waiting{false};
 };
 
 EvlConditionVariable::EvlConditionVariable(int id) : _id(id)
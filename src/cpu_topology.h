@@ -0,0 +1,252 @@
+/*
+ * Copyright Copyright 2017-2023 Elk Audio AB
+ * Twine is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Cpu topology probing from sysfs and topology aware worker placement
+ * @copyright 2017-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef TWINE_CPU_TOPOLOGY_H
+#define TWINE_CPU_TOPOLOGY_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "twine/twine.h"
+
+namespace twine {
+
+/**
+ * @brief Parse a cpu list in the kernel's format, i.e. comma separated cpu ids
+ *        and inclusive ranges of ids, as in "0-3,8,10-11".
+ * @param str The string to parse, trailing whitespace is ignored
+ * @return The cpu ids in the order listed, or an empty vector if str is malformed
+ */
+inline std::vector<int> parse_cpu_list(const std::string& str)
+{
+    std::vector<int> list;
+    std::stringstream stream(str);
+    std::string item;
+    try
+    {
+        while (std::getline(stream, item, ','))
+        {
+            item.erase(item.find_last_not_of(" \t\n") + 1);
+            if (item.empty())
+            {
+                continue;
+            }
+            size_t end;
+            int first = std::stoi(item, &end);
+            int last = first;
+            if (end < item.size())
+            {
+                if (item[end] != '-')
+                {
+                    return {};
+                }
+                size_t range_end;
+                last = std::stoi(item.substr(end + 1), &range_end);
+                if (end + 1 + range_end != item.size())
+                {
+                    return {};
+                }
+            }
+            if (first < 0 || last < first)
+            {
+                return {};
+            }
+            for (int i = first; i <= last; ++i)
+            {
+                list.push_back(i);
+            }
+        }
+    }
+    catch (std::exception& e)
+    {
+        return {};
+    }
+    return list;
+}
+
+/**
+ * @brief Read the first line of a sysfs file
+ * @return The line or std::nullopt if the file could not be read
+ */
+inline std::optional<std::string> read_sysfs_line(const std::string& path)
+{
+    std::ifstream file(path);
+    std::string line;
+    if (file.is_open() && std::getline(file, line))
+    {
+        return line;
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief Read a cpu list from sysfs and identify the set of cpus by its lowest id
+ * @return The lowest cpu id in the list, or -1 if the file could not be read
+ */
+inline int read_cpu_set_id(const std::string& path)
+{
+    auto line = read_sysfs_line(path);
+    if (line.has_value())
+    {
+        auto cpus = parse_cpu_list(line.value());
+        if (cpus.empty() == false)
+        {
+            return *std::min_element(cpus.begin(), cpus.end());
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Fill in the topology fields of a list of cores from sysfs. Fields that can
+ *        not be read, i.e. on systems without sysfs, are left at -1.
+ * @param sysfs_cpu_path The directory with the cpu entries, normally DEFAULT_SYSFS_CPU_PATH
+ * @param cores The cores to read the topology of
+ */
+inline void read_cpu_topology(const std::string& sysfs_cpu_path, std::vector<CpuInfo>& cores)
+{
+    for (auto& core : cores)
+    {
+        auto cpu_path = sysfs_cpu_path + "/cpu" + std::to_string(core.id);
+        core.core = read_cpu_set_id(cpu_path + "/topology/thread_siblings_list");
+        auto package = read_sysfs_line(cpu_path + "/topology/physical_package_id");
+        core.package = package.has_value() ? std::atoi(package.value().c_str()) : -1;
+
+        // Cache indices are numbered from 0 without gaps
+        for (int index = 0; ; ++index)
+        {
+            auto cache_path = cpu_path + "/cache/index" + std::to_string(index);
+            auto level = read_sysfs_line(cache_path + "/level");
+            if (level.has_value() == false)
+            {
+                break;
+            }
+            if (read_sysfs_line(cache_path + "/type").value_or("") == "Instruction")
+            {
+                continue;
+            }
+            if (level.value() == "2")
+            {
+                core.l2_cache = read_cpu_set_id(cache_path + "/shared_cpu_list");
+            }
+            else if (level.value() == "3")
+            {
+                core.l3_cache = read_cpu_set_id(cache_path + "/shared_cpu_list");
+            }
+        }
+
+        // The cpu directory has a nodeN link for the numa node it belongs to
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(cpu_path, error))
+        {
+            auto name = entry.path().filename().string();
+            if (name.rfind("node", 0) == 0 && name.size() > 4 &&
+                std::all_of(name.begin() + 4, name.end(), [](char c) {return std::isdigit(c);}))
+            {
+                core.numa_node = std::stoi(name.substr(4));
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief The cost of running one more worker on a core, lower is better. Workers on
+ *        SMT siblings compete for the same execution units, so the load of a core is
+ *        the number of workers on the whole physical core. Among equally loaded cores,
+ *        one with fewer workers of its own is preferred. Then, since workers in a pool
+ *        exchange data every cycle, cores that share an L2 cache, an L3 cache or a numa
+ *        node with cores already running workers are preferred, in that order.
+ * @param cores The cores and the workers already placed on them
+ * @param candidate The core to evaluate
+ */
+inline auto worker_placement_cost(const std::vector<CpuInfo>& cores, const CpuInfo& candidate)
+{
+    int busy_siblings = 0;
+    bool shares_l2 = false;
+    bool shares_l3 = false;
+    bool shares_node = false;
+    for (const auto& other : cores)
+    {
+        if (other.id == candidate.id || other.workers == 0)
+        {
+            continue;
+        }
+        busy_siblings += (candidate.core >= 0 && other.core == candidate.core) ? other.workers : 0;
+        shares_l2 |= candidate.l2_cache >= 0 && other.l2_cache == candidate.l2_cache;
+        shares_l3 |= candidate.l3_cache >= 0 && other.l3_cache == candidate.l3_cache;
+        shares_node |= candidate.numa_node >= 0 && other.numa_node == candidate.numa_node;
+    }
+    return std::make_tuple(candidate.workers + busy_siblings, candidate.workers, !shares_l2, !shares_l3, !shares_node);
+}
+
+/**
+ * @brief Pick the core to run a new worker on, see worker_placement_cost().
+ *        Ties are resolved by the order of cores.
+ * @param cores The cores to choose from, must not be empty
+ * @return An iterator to the chosen core
+ */
+inline std::vector<CpuInfo>::iterator pick_worker_core(std::vector<CpuInfo>& cores)
+{
+    return std::min_element(cores.begin(), cores.end(), [&](auto& lhs, auto& rhs)
+    {
+        return worker_placement_cost(cores, lhs) < worker_placement_cost(cores, rhs);
+    });
+}
+
+/**
+ * @brief Order cpus so that any number of them taken from the front is a good set
+ *        of cores for a pool. Every cpu is picked as if a worker was placed on it,
+ *        so one cpu per physical core comes before any SMT sibling, and cpus sharing
+ *        caches or a numa node with the ones before them are preferred.
+ * @param cpus The cpus with their topology, see read_cpu_topology()
+ * @return The same cpus in the order they should be used, without workers
+ */
+inline std::vector<CpuInfo> order_cpus_by_topology(std::vector<CpuInfo> cpus)
+{
+    std::vector<CpuInfo> ordered;
+    ordered.reserve(cpus.size());
+    while (cpus.empty() == false)
+    {
+        auto next = std::min_element(cpus.begin(), cpus.end(), [&](auto& lhs, auto& rhs)
+        {
+            return worker_placement_cost(ordered, lhs) < worker_placement_cost(ordered, rhs);
+        });
+        ordered.push_back(*next);
+        ordered.back().workers = 1;
+        cpus.erase(next);
+    }
+    for (auto& cpu : ordered)
+    {
+        cpu.workers = 0;
+    }
+    return ordered;
+}
+
+} // namespace twine
+
+#endif //TWINE_CPU_TOPOLOGY_H
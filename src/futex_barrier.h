@@ -0,0 +1,332 @@
+/*
+ * Copyright Copyright 2017-2023 Elk Audio AB
+ * Twine is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Linux specific worker barrier built directly on futexes
+ * @copyright 2017-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef TWINE_FUTEX_BARRIER_H
+#define TWINE_FUTEX_BARRIER_H
+
+#ifdef __linux__
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cassert>
+#include <climits>
+#include <cstdint>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "twine_internal.h"
+#include "trace_ring.h"
+
+#define TWINE_HAS_FUTEX_BARRIER
+
+namespace twine {
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "Futex words must be plain 32 bit integers");
+
+inline long futex_wait(std::atomic<uint32_t>* word, uint32_t expected, const timespec* timeout = nullptr)
+{
+    // The timeout is relative and measured on CLOCK_MONOTONIC
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+}
+
+inline long futex_wake(std::atomic<uint32_t>* word, int count)
+{
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+inline long futex_wait_bitset(std::atomic<uint32_t>* word, uint32_t expected, uint32_t bitset)
+{
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_BITSET_PRIVATE, expected, nullptr, nullptr, bitset);
+}
+
+inline long futex_wake_bitset(std::atomic<uint32_t>* word, int count, uint32_t bitset)
+{
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_BITSET_PRIVATE, count, nullptr, nullptr, bitset);
+}
+
+/**
+ * @brief Barrier with the same interface as BarrierWithTrigger, for regular
+ *        linux threads only. Waiting threads sleep on a generation counter and
+ *        releasing all of them takes a single FUTEX_WAKE. A subset of the threads
+ *        is released through per thread release counts and woken with a bitset
+ *        wake, so that the other threads stay asleep. The calling thread sleeps on
+ *        the arrival counter and is woken by the last arriving thread.
+ */
+class FutexBarrier
+{
+public:
+    TWINE_DECLARE_NON_COPYABLE(FutexBarrier);
+
+    static constexpr bool SELECTIVE_RELEASE = true;
+
+    FutexBarrier() = default;
+
+    /**
+     * @brief Wait for signal to finish, called from threads participating on the
+     *        barrier
+     * @param thread_index The index of the calling thread, unique among the threads
+     *                     on the barrier and less than MAX_WORKERS_PER_POOL
+     * @return true if the wait ended while spinning, false if the thread had to sleep
+     */
+    bool wait(int thread_index)
+    {
+        assert(thread_index >= 0 && thread_index < MAX_WORKERS_PER_POOL);
+        auto& slot = _slots[thread_index];
+        // Must be read before arriving, the barrier can be released as soon as the last thread arrives
+        auto release_count = slot.release_count.load(std::memory_order_acquire);
+        auto full_releases = _full_releases.load(std::memory_order_acquire);
+        auto released = [&]()
+        {
+            return _full_releases.load(std::memory_order_seq_cst) != full_releases ||
+                   slot.release_count.load(std::memory_order_seq_cst) != release_count;
+        };
+        auto arrived = _no_threads_currently_on_barrier.fetch_add(1, std::memory_order_seq_cst) + 1;
+        if (arrived >= _no_threads.load(std::memory_order_relaxed) && _caller_waiting.load(std::memory_order_seq_cst))
+        {
+            futex_wake(&_no_threads_currently_on_barrier, 1);
+        }
+
+        if (spin_until(_wait_policy, _spin_time, released))
+        {
+            return true;
+        }
+
+        // Announcing the sleeper before re-checking for the release lets release()
+        // skip the wake syscall entirely when the thread is still spinning.
+        auto thread_bit = WorkerMask(1) << thread_index;
+        _sleeping_threads.fetch_or(thread_bit, std::memory_order_seq_cst);
+        while (true)
+        {
+            // Every release advances the generation, so futex_wait returns immediately
+            // if any release happened after the check. Releases of other threads only
+            // cause another check, they don't wake this thread up.
+            auto generation = _generation.load(std::memory_order_seq_cst);
+            if (released())
+            {
+                break;
+            }
+            futex_wait_bitset(&_generation, generation, _wake_bits(thread_bit));
+        }
+        _sleeping_threads.fetch_and(~thread_bit, std::memory_order_relaxed);
+        return false;
+    }
+
+    /**
+     * @brief Wait for all threads to halt on the barrier, called from a thread
+     *        not waiting on the barrier and will block until all threads are
+     *        waiting on the barrier.
+     * @return true if the wait ended while spinning, false if the thread had to sleep
+     */
+    bool wait_for_all()
+    {
+        _trace.record(TraceEvent::WAIT_BEGIN, 0);
+        bool spun = _wait_for_all();
+        _trace.record(TraceEvent::WAIT_END, spun);
+        return spun;
+    }
+
+    /**
+     * @brief Wait for all threads to halt on the barrier, but give up at deadline.
+     *        If the wait times out, the threads must be waited for again before
+     *        they are released.
+     * @param deadline In the time base of current_rt_time()
+     * @return true if all threads are waiting on the barrier, false if the wait timed out
+     */
+    bool wait_for_all_until(std::chrono::nanoseconds deadline)
+    {
+        if (_all_threads_on_barrier())
+        {
+            return true;
+        }
+        _trace.record(TraceEvent::WAIT_BEGIN, 0);
+        _caller_waiting.store(true, std::memory_order_seq_cst);
+        uint32_t arrived;
+        std::chrono::nanoseconds now;
+        while ((arrived = _no_threads_currently_on_barrier.load(std::memory_order_seq_cst)) < _no_threads.load(std::memory_order_relaxed) &&
+               (now = current_rt_time()) < deadline)
+        {
+            auto timeout = to_timespec(deadline - now);
+            futex_wait(&_no_threads_currently_on_barrier, arrived, &timeout);
+        }
+        _caller_waiting.store(false, std::memory_order_relaxed);
+        _trace.record(TraceEvent::WAIT_END, 0);
+        return _all_threads_on_barrier();
+    }
+
+    /**
+     * @brief Check if all threads are waiting on the barrier, without blocking
+     */
+    bool all_threads_waiting() const
+    {
+        return _all_threads_on_barrier();
+    }
+
+    /**
+     * @brief Change the number of threads for the barrier to handle, the threads
+     *        will have indices [0, threads).
+     * @param threads
+     */
+    void set_no_threads(int threads)
+    {
+        assert(threads <= MAX_WORKERS_PER_POOL);
+        set_threads(first_workers_mask(threads));
+    }
+
+    /**
+     * @brief Change which threads the barrier handles.
+     * @param threads Bit i is set if the thread with index i is on the barrier
+     */
+    void set_threads(WorkerMask threads)
+    {
+        _threads = threads;
+        _no_threads.store(static_cast<uint32_t>(std::popcount(threads)), std::memory_order_seq_cst);
+    }
+
+    /**
+     * @brief Set how threads wait on the barrier. Must be set before any thread waits.
+     * @param policy The wait policy for both the threads on the barrier and the caller
+     * @param spin_time The maximum spin time if policy is WaitPolicy::SPIN_THEN_BLOCK
+     */
+    void set_wait_policy(WaitPolicy policy, std::chrono::nanoseconds spin_time)
+    {
+        _wait_policy = policy;
+        _spin_time = spin_time;
+    }
+
+    /**
+     * @brief Release the threads selected by mask, the other threads stay on the
+     *        barrier without waking up. Must only be called when all threads are
+     *        waiting on the barrier.
+     * @param mask Bit i selects the thread with index i
+     */
+    void release(WorkerMask mask)
+    {
+        assert(_all_threads_on_barrier());
+        mask &= _threads;
+        int released = std::popcount(mask);
+        // Threads left on the barrier are still counted as arrived
+        _no_threads_currently_on_barrier.store(std::popcount(_threads) - released, std::memory_order_seq_cst);
+        bool full_release = mask == _threads;
+        if (full_release)
+        {
+            _full_releases.fetch_add(1, std::memory_order_seq_cst);
+        }
+        else
+        {
+            for (auto bits = mask; bits != 0; bits &= bits - 1)
+            {
+                _slots[std::countr_zero(bits)].release_count.fetch_add(1, std::memory_order_seq_cst);
+            }
+        }
+        _generation.fetch_add(1, std::memory_order_seq_cst);
+        auto sleeping = _sleeping_threads.load(std::memory_order_seq_cst) & mask;
+        if (sleeping != 0)
+        {
+            futex_wake_bitset(&_generation, INT_MAX, full_release ? FUTEX_BITSET_MATCH_ANY : _wake_bits(sleeping));
+        }
+        _trace.record(TraceEvent::RELEASE, released);
+    }
+
+    /**
+     * @brief Release all threads waiting on the barrier.
+     */
+    void release_all()
+    {
+        release(ALL_WORKERS);
+    }
+
+    bool release_and_wait(WorkerMask mask = ALL_WORKERS)
+    {
+        release(mask);
+        return wait_for_all();
+    }
+
+    /**
+     * @brief The trace records of the thread controlling the barrier
+     */
+    TraceRing& trace_ring()
+    {
+        return _trace;
+    }
+
+private:
+    bool _all_threads_on_barrier() const
+    {
+        return _no_threads_currently_on_barrier.load(std::memory_order_seq_cst) >= _no_threads.load(std::memory_order_relaxed);
+    }
+
+    // Futex bitsets are 32 bits wide, threads i and i + 32 share a bit and may wake each other
+    static uint32_t _wake_bits(WorkerMask threads)
+    {
+        return static_cast<uint32_t>(threads) | static_cast<uint32_t>(threads >> 32);
+    }
+
+    bool _wait_for_all()
+    {
+        if (_all_threads_on_barrier() || spin_until(_wait_policy, _spin_time, [&]() {return _all_threads_on_barrier();}))
+        {
+            return true;
+        }
+
+        _caller_waiting.store(true, std::memory_order_seq_cst);
+        uint32_t arrived;
+        while ((arrived = _no_threads_currently_on_barrier.load(std::memory_order_seq_cst)) < _no_threads.load(std::memory_order_relaxed))
+        {
+            futex_wait(&_no_threads_currently_on_barrier, arrived);
+        }
+        _caller_waiting.store(false, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Only used for releasing a subset of the threads
+    struct alignas(CACHE_LINE_SIZE) ThreadSlot
+    {
+        std::atomic<uint32_t> release_count{0};
+    };
+
+    std::array<ThreadSlot, MAX_WORKERS_PER_POOL> _slots;
+    WorkerMask            _threads{0};
+
+    std::atomic<uint32_t> _no_threads{0};
+
+    WaitPolicy               _wait_policy{WaitPolicy::BLOCK};
+    std::chrono::nanoseconds _spin_time{DEFAULT_SPIN_TIME};
+
+    // Written by every arriving thread and by the calling thread, read by the last one to arrive
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> _no_threads_currently_on_barrier{0};
+    std::atomic_bool      _caller_waiting{false};
+    std::atomic<WorkerMask> _sleeping_threads{0};
+
+    // Written by the calling thread on every release
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> _generation{0};
+    std::atomic<uint32_t> _full_releases{0};
+
+    alignas(CACHE_LINE_SIZE) TraceRing _trace{CALLER_TRACE_THREAD};
+};
+
+} // namespace twine
+
+#endif // __linux__
+
+#endif //TWINE_FUTEX_BARRIER_H
@@ -0,0 +1,219 @@
+/*
+ * Copyright Copyright 2017-2023 Elk Audio AB
+ * Twine is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Dependency graph of jobs for running inside a WorkerPool cycle
+ * @copyright 2017-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef TWINE_JOB_GRAPH_H
+#define TWINE_JOB_GRAPH_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <utility>
+
+#include "twine/twine.h"
+#include "thread_helpers.h"
+#include "twine_internal.h"
+
+namespace twine {
+
+// Number of empty polls of the ready queue before a thread yields its cpu
+constexpr int JOB_GRAPH_SPIN_COUNT = 64;
+
+/**
+ * @brief A set of jobs with dependencies between them. Jobs are added from a
+ *        non-rt thread and can then be run any number of times by several
+ *        threads in parallel. A job is started by the first free thread as soon
+ *        as all its predecessors have finished. Running the graph does not
+ *        allocate memory or take any locks. Helper is the thread helper policy
+ *        used for yielding while waiting for running jobs.
+ */
+template <typename Helper>
+class JobGraph
+{
+public:
+    TWINE_DECLARE_NON_COPYABLE(JobGraph);
+
+    JobGraph() = default;
+
+    /**
+     * @brief Add a job to the graph. Not safe to call while the graph is running.
+     * @param job_cb The function to call when the job is run
+     * @param job_data A data pointer that will be passed to job_cb
+     * @param predecessors The ids of the jobs that must finish before this job
+     *                     can start. Must refer to jobs already in the graph,
+     *                     which also makes it impossible to create cycles.
+     * @return WorkerPoolStatus::OK and the id of the new job if successful,
+     *         an error status and -1 otherwise
+     */
+    std::pair<WorkerPoolStatus, int> add_job(WorkerCallback job_cb, void* job_data, const std::vector<int>& predecessors)
+    {
+        int id = static_cast<int>(_jobs.size());
+        if (job_cb == nullptr)
+        {
+            return {WorkerPoolStatus::INVALID_ARGUMENTS, -1};
+        }
+        for (auto predecessor : predecessors)
+        {
+            if (predecessor < 0 || predecessor >= id)
+            {
+                return {WorkerPoolStatus::INVALID_ARGUMENTS, -1};
+            }
+        }
+
+        _jobs.push_back({job_cb, job_data, static_cast<int>(predecessors.size()), {}});
+        for (auto predecessor : predecessors)
+        {
+            _jobs[predecessor].successors.push_back(id);
+        }
+        _pending_predecessors = std::make_unique<std::atomic<int>[]>(_jobs.size());
+        _ready_queue = std::make_unique<std::atomic<int>[]>(_jobs.size());
+        return {WorkerPoolStatus::OK, id};
+    }
+
+    /**
+     * @brief Remove all jobs from the graph. Not safe to call while the graph is running.
+     */
+    void clear()
+    {
+        _jobs.clear();
+        _pending_predecessors.reset();
+        _ready_queue.reset();
+    }
+
+    [[nodiscard]] int size() const
+    {
+        return static_cast<int>(_jobs.size());
+    }
+
+    /**
+     * @brief Reset the graph before a new run. Must be called from the thread
+     *        that triggers the run before any thread calls run_ready_jobs().
+     */
+    void prepare()
+    {
+        int jobs = size();
+        for (int i = 0; i < jobs; ++i)
+        {
+            _pending_predecessors[i].store(_jobs[i].predecessor_count, std::memory_order_relaxed);
+            _ready_queue[i].store(NO_JOB, std::memory_order_relaxed);
+        }
+        _ready_head.store(0, std::memory_order_relaxed);
+        _ready_tail.store(0, std::memory_order_relaxed);
+        _unfinished_jobs.store(jobs, std::memory_order_relaxed);
+
+        for (int i = 0; i < jobs; ++i)
+        {
+            if (_jobs[i].predecessor_count == 0)
+            {
+                _push_ready(i);
+            }
+        }
+    }
+
+    /**
+     * @brief Run jobs as they become ready. Called concurrently from every thread
+     *        participating in a run and returns when all jobs in the graph have
+     *        finished.
+     */
+    void run_ready_jobs()
+    {
+        int idle_polls = 0;
+        while (_unfinished_jobs.load(std::memory_order_acquire) > 0)
+        {
+            int id = _pop_ready();
+            if (id == NO_JOB)
+            {
+                // The remaining jobs are either running or waiting for running jobs to finish
+                if (++idle_polls < JOB_GRAPH_SPIN_COUNT)
+                {
+                    cpu_pause();
+                }
+                else
+                {
+                    // Give other workers sharing this core a chance to finish their jobs
+                    idle_polls = 0;
+                    Helper::thread_yield();
+                }
+                continue;
+            }
+            idle_polls = 0;
+
+            auto& job = _jobs[id];
+            job.callback(job.data);
+
+            for (auto successor : job.successors)
+            {
+                if (_pending_predecessors[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    _push_ready(successor);
+                }
+            }
+            _unfinished_jobs.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+private:
+    static constexpr int NO_JOB = -1;
+
+    /* Every job is pushed exactly once per run, so the ready queue never needs
+     * more slots than there are jobs and indices never wrap around */
+    void _push_ready(int id)
+    {
+        int slot = _ready_tail.fetch_add(1, std::memory_order_relaxed);
+        _ready_queue[slot].store(id, std::memory_order_release);
+    }
+
+    int _pop_ready()
+    {
+        int head = _ready_head.load(std::memory_order_relaxed);
+        while (head < _ready_tail.load(std::memory_order_acquire))
+        {
+            if (_ready_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+            {
+                int id;
+                // The slot might be reserved, but not yet written, by the pushing thread
+                while ((id = _ready_queue[head].load(std::memory_order_acquire)) == NO_JOB)
+                {
+                    cpu_pause();
+                }
+                return id;
+            }
+        }
+        return NO_JOB;
+    }
+
+    struct Job
+    {
+        WorkerCallback   callback;
+        void*            data;
+        int              predecessor_count;
+        std::vector<int> successors;
+    };
+
+    std::vector<Job>                    _jobs;
+    std::unique_ptr<std::atomic<int>[]> _pending_predecessors;
+    std::unique_ptr<std::atomic<int>[]> _ready_queue;
+
+    std::atomic<int>                    _ready_head{0};
+    std::atomic<int>                    _ready_tail{0};
+    std::atomic<int>                    _unfinished_jobs{0};
+};
+
+} // namespace twine
+
+#endif //TWINE_JOB_GRAPH_H
@@ -0,0 +1,208 @@
+/*
+ * Copyright Copyright 2017-2023 Elk Audio AB
+ * Twine is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Work-stealing scheduler for running a range of work in parallel inside a WorkerPool cycle
+ * @copyright 2017-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef TWINE_PARALLEL_FOR_H
+#define TWINE_PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+#include "twine/twine.h"
+#include "twine_internal.h"
+
+namespace twine {
+
+/**
+ * @brief Splits a range into chunks that are distributed evenly over one deque per
+ *        participating thread. Every thread runs chunks from its own deque and when
+ *        that is empty, steals chunks from the other threads' deques until there is
+ *        no work left anywhere. Running does not allocate memory or take any locks.
+ */
+class ParallelFor
+{
+public:
+    TWINE_DECLARE_NON_COPYABLE(ParallelFor);
+
+    ParallelFor() = default;
+
+    /**
+     * @brief Set the number of threads that will run chunks, including the calling
+     *        thread. Allocates memory, so not safe to call while a range is running.
+     * @param participants The number of threads
+     */
+    void set_participants(int participants)
+    {
+        assert(participants > 0);
+        _deques = std::make_unique<ChunkDeque[]>(participants);
+        _participants = participants;
+    }
+
+    [[nodiscard]] int participants() const
+    {
+        return _participants;
+    }
+
+    /**
+     * @brief Distribute a new range over the deques. Must be called from the thread
+     *        that triggers the run before any thread calls run_chunks().
+     * @param begin The first index of the range
+     * @param end One past the last index of the range
+     * @param grain The maximum number of indices in a chunk, must be > 0. Ranges
+     *        with more than INT_MAX chunks use larger chunks.
+     * @param callback The function called for every chunk
+     * @param data A data pointer passed to callback
+     */
+    void prepare(int begin, int end, int grain, RangeCallback callback, void* data)
+    {
+        assert(grain > 0 && begin <= end);
+        // The range and chunk bounds can overflow an int, so they are computed in 64 bits
+        int64_t length = static_cast<int64_t>(end) - begin;
+        constexpr int64_t MAX_CHUNKS = std::numeric_limits<int>::max();
+        _begin = begin;
+        _end = end;
+        _grain = std::max<int64_t>(grain, (length + MAX_CHUNKS - 1) / MAX_CHUNKS);
+        _callback = callback;
+        _data = data;
+
+        int chunks = static_cast<int>((length + _grain - 1) / _grain);
+        int first_chunk = 0;
+        for (int i = 0; i < _participants; ++i)
+        {
+            // Spread the remainder over the first deques
+            int chunk_count = chunks / _participants + (i < chunks % _participants ? 1 : 0);
+            _deques[i].top.store(first_chunk, std::memory_order_relaxed);
+            _deques[i].bottom.store(first_chunk + chunk_count, std::memory_order_relaxed);
+            first_chunk += chunk_count;
+        }
+    }
+
+    /**
+     * @brief Run chunks until there are none left to start. Called concurrently from
+     *        every participating thread, each with a unique index. Returns when all
+     *        chunks have been started, though chunks stolen by other threads might
+     *        still be running.
+     * @param participant The index of the calling thread in [0, participants)
+     */
+    void run_chunks(int participant)
+    {
+        assert(participant >= 0 && participant < _participants);
+        auto& own_deque = _deques[participant];
+        while (true)
+        {
+            int chunk = own_deque.pop();
+            if (chunk == NO_CHUNK)
+            {
+                chunk = _steal(participant);
+                if (chunk == NO_CHUNK)
+                {
+                    return;
+                }
+            }
+            int64_t chunk_begin = _begin + chunk * _grain;
+            _callback(static_cast<int>(chunk_begin), static_cast<int>(std::min<int64_t>(chunk_begin + _grain, _end)), _data);
+        }
+    }
+
+private:
+    static constexpr int NO_CHUNK = -1;
+    static constexpr int STEAL_CONTENDED = -2;
+
+    /* A Chase-Lev deque where all items are known up front, so it only needs
+     * to store the range of chunk indices that has not been taken yet. The owner
+     * takes chunks from the bottom and thieves take chunks from the top. */
+    struct alignas(CACHE_LINE_SIZE) ChunkDeque
+    {
+        std::atomic<int> top{0};
+        std::atomic<int> bottom{0};
+
+        int pop()
+        {
+            int b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int t = top.load(std::memory_order_relaxed);
+            if (t > b)
+            {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return NO_CHUNK;
+            }
+            if (t == b)
+            {
+                // Last chunk, race any thieves for it
+                bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return won ? b : NO_CHUNK;
+            }
+            return b;
+        }
+
+        int steal()
+        {
+            int t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int b = bottom.load(std::memory_order_acquire);
+            if (t >= b)
+            {
+                return NO_CHUNK;
+            }
+            if (top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed) == false)
+            {
+                return STEAL_CONTENDED;
+            }
+            return t;
+        }
+    };
+
+    int _steal(int thief)
+    {
+        bool contended = true;
+        while (contended)
+        {
+            contended = false;
+            for (int i = 1; i < _participants; ++i)
+            {
+                int chunk = _deques[(thief + i) % _participants].steal();
+                if (chunk >= 0)
+                {
+                    return chunk;
+                }
+                // A lost race means the victim might still have chunks left
+                contended |= (chunk == STEAL_CONTENDED);
+            }
+        }
+        return NO_CHUNK;
+    }
+
+    std::unique_ptr<ChunkDeque[]> _deques;
+    int                           _participants{0};
+
+    int                           _begin{0};
+    int                           _end{0};
+    int64_t                       _grain{1};
+    RangeCallback                 _callback{nullptr};
+    void*                         _data{nullptr};
+};
+
+} // namespace twine
+
+#endif //TWINE_PARALLEL_FOR_H
@@ -13,30 +13,51 @@
  */
 
 /**
- * @brief Templated helper functions to make the Workerpool implementation thread-agnostic.
+ * @brief Static thread helper policies to make the Workerpool implementation thread-agnostic.
  * @copyright 2017-2023 Elk Audio AB, Stockholm
  */
 
 #ifndef TWINE_THREAD_HELPERS_H
 #define TWINE_THREAD_HELPERS_H
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <cstdint>
 
 #ifdef TWINE_WINDOWS_THREADING
 #include "windows_threading.h"
 #else
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
 #include <fcntl.h>
 #endif
 
+#ifdef TWINE_BUILD_WITH_XENOMAI
+    #include "elk-warning-suppressor/warning_suppressor.hpp"
+
+    ELK_PUSH_WARNING
+    ELK_DISABLE_UNUSED_PARAMETER
+    #include <cobalt/pthread.h>
+    #include <cobalt/semaphore.h>
+    #include <cobalt/sched.h>
+    ELK_POP_WARNING
+#endif
+
 #ifdef TWINE_BUILD_WITH_EVL
+    #include <unistd.h>
     #include <evl/evl.h>
     #include <evl/clock.h>
     #include <evl/mutex.h>
+    #include <evl/sched.h>
+    #include <evl/event.h>
 #endif
 
+#include "twine/twine.h"
+#include "twine_internal.h"
+
 
 namespace twine {
 
@@ -47,231 +68,431 @@ enum class ThreadType : uint32_t
     EVL
 };
 
-// Empty base classes for the generic arguments of ThreadHelper
-
-struct BaseMutex
-{
-    virtual ~BaseMutex() = 0;
-};
-
-struct BaseCondVar
-{
-    virtual ~BaseCondVar() = 0;
-};
-
-struct BaseSemaphore
-{
-    virtual ~BaseSemaphore() = 0;
-};
-
-
 /**
- * @brief Stateless pure virtual interface for wrapping thread functions
- *        implemented by the different libraries (POSIX, cobalt, EVL)
+ * @brief Thread functions implemented by the different libraries (POSIX, cobalt, EVL),
+ *        wrapped in classes with a common static interface. Templates take one of
+ *        these as a policy, so calls go straight to the library functions and can
+ *        be inlined. The primitive types are stored by value in the objects using them.
  */
-class BaseThreadHelper
-{
-public:
-    virtual ~BaseThreadHelper();
-
-    virtual int mutex_create(BaseMutex* mutex, [[maybe_unused]] const char* name) = 0;
-
-    virtual int mutex_destroy(BaseMutex* mutex) = 0;
-
-    virtual int mutex_lock(BaseMutex* mutex) = 0;
-
-    virtual int mutex_unlock(BaseMutex* mutex) = 0;
-
-    virtual int condition_var_create(BaseCondVar* condition_var, [[maybe_unused]] const char* name) = 0;
-
-    virtual int condition_var_destroy(BaseCondVar* condition_var) = 0;
-
-    virtual int condition_wait(BaseCondVar* condition_var, BaseMutex* mutex) = 0;
-
-    virtual int condition_signal(BaseCondVar* condition_var) = 0;
-
-    virtual int thread_create(pthread_t* thread, const pthread_attr_t* attributes, void *(*entry_fun) (void *), void* argument) = 0;
-
-    virtual int thread_join(pthread_t thread, void** return_var) = 0;
-
-    virtual int semaphore_create(BaseSemaphore* semaphore, [[maybe_unused]] const char* name) = 0;
-
-    virtual int semaphore_destroy(BaseSemaphore* semaphore, [[maybe_unused]] const char* name) = 0;
-
-    virtual int semaphore_wait(BaseSemaphore* semaphore) = 0;
-
-    virtual int semaphore_signal(BaseSemaphore* semaphore) = 0;
-};
-
-
-class PosixThreadHelper : public BaseThreadHelper
+class PosixThreadHelper
 {
 public:
-    PosixThreadHelper() = default;
-    virtual ~PosixThreadHelper() override {};
-
-
-    int mutex_create(BaseMutex* mutex, [[maybe_unused]] const char* name) override;
-
-    int mutex_destroy(BaseMutex* mutex) override;
-
-    int mutex_lock(BaseMutex* mutex) override;
-
-    int mutex_unlock(BaseMutex* mutex) override;
-
-    int condition_var_create(BaseCondVar* condition_var, [[maybe_unused]] const char* name) override;
-
-    int condition_var_destroy(BaseCondVar* condition_var) override;
-
-    int condition_wait(BaseCondVar* condition_var, BaseMutex* mutex) override;
-
-    int condition_signal(BaseCondVar* condition_var) override;
-
-    int thread_create(pthread_t* thread, const pthread_attr_t* attributes, void *(*entry_fun) (void *), void* argument) override;
-
-    int thread_join(pthread_t thread, void** return_var) override;
-
-    int semaphore_create(BaseSemaphore* semaphore, [[maybe_unused]] const char* name) override;
-
-    int semaphore_destroy(BaseSemaphore* semaphore, [[maybe_unused]] const char* name) override;
-
-    int semaphore_wait(BaseSemaphore* semaphore) override;
-
-    int semaphore_signal(BaseSemaphore* semaphore) override;
-};
-
-// These are shared between POSIX and Cobalt,
-// and cause no issues for any build configuration, so it's fine to declare them here
-
-struct PosixMutex : BaseMutex
-{
-    pthread_mutex_t mutex;
-};
+    using Mutex = pthread_mutex_t;
+    using CondVar = pthread_cond_t;
+#ifdef __APPLE__
+    // macOS does not support unnamed semaphores
+    using Semaphore = sem_t*;
+#else
+    using Semaphore = sem_t;
+#endif
 
-struct PosixCondVar : BaseCondVar
-{
-    pthread_cond_t cond_var;
-};
+    static int mutex_create(Mutex* mutex, [[maybe_unused]] const char* name)
+    {
+        return pthread_mutex_init(mutex, nullptr);
+    }
+
+    static int mutex_destroy(Mutex* mutex)
+    {
+        return pthread_mutex_destroy(mutex);
+    }
+
+    static int mutex_lock(Mutex* mutex)
+    {
+        return pthread_mutex_lock(mutex);
+    }
+
+    static int mutex_unlock(Mutex* mutex)
+    {
+        return pthread_mutex_unlock(mutex);
+    }
+
+    static int condition_var_create(CondVar* condition_var, [[maybe_unused]] const char* name)
+    {
+#ifdef __APPLE__
+        return pthread_cond_init(condition_var, nullptr);
+#else
+        // Timed waits use the same clock as current_rt_time()
+        pthread_condattr_t attributes;
+        pthread_condattr_init(&attributes);
+        pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+        int res = pthread_cond_init(condition_var, &attributes);
+        pthread_condattr_destroy(&attributes);
+        return res;
+#endif
+    }
+
+    static int condition_var_destroy(CondVar* condition_var)
+    {
+        return pthread_cond_destroy(condition_var);
+    }
+
+    static int condition_wait(CondVar* condition_var, Mutex* mutex)
+    {
+        return pthread_cond_wait(condition_var, mutex);
+    }
+
+    /**
+     * @brief Wait on a condition variable until it is signalled or until deadline,
+     *        given in the time base of current_rt_time()
+     * @return 0 if signalled, ETIMEDOUT if the deadline passed or another error code
+     */
+    static int condition_timed_wait(CondVar* condition_var, Mutex* mutex, std::chrono::nanoseconds deadline)
+    {
+#ifdef __APPLE__
+        auto timeout = to_timespec(std::max(deadline - current_rt_time(), std::chrono::nanoseconds(0)));
+        return pthread_cond_timedwait_relative_np(condition_var, mutex, &timeout);
+#else
+        auto timeout = to_timespec(deadline);
+        return pthread_cond_timedwait(condition_var, mutex, &timeout);
+#endif
+    }
+
+    static int condition_signal(CondVar* condition_var)
+    {
+        return pthread_cond_signal(condition_var);
+    }
+
+    static int thread_create(pthread_t* thread, const pthread_attr_t* attributes, void *(*entry_fun) (void *), void* argument)
+    {
+        return pthread_create(thread, attributes, entry_fun, argument);
+    }
+
+    static int thread_join(pthread_t thread, void** return_var)
+    {
+        return pthread_join(thread, return_var);
+    }
+
+    /* Unnamed semaphores are private to the process, so independent pools never share
+     * them, and creating one does not need any file system operations. The name is
+     * only used on macOS, where it is unlinked as soon as the semaphore is opened. */
+    static int semaphore_create(Semaphore* semaphore, [[maybe_unused]] const char* name)
+    {
+#ifdef __APPLE__
+        sem_unlink(name);
+        *semaphore = sem_open(name, O_CREAT | O_EXCL, 0, 0);
+        if (*semaphore == SEM_FAILED)
+        {
+            return errno;
+        }
+        sem_unlink(name);
+#else
+        if (sem_init(semaphore, 0, 0) != 0)
+        {
+            return errno;
+        }
+#endif
+        return 0;
+    }
 
-struct PosixSemaphore : BaseSemaphore
-{
-    sem_t* semaphore;
+    static int semaphore_destroy(Semaphore* semaphore, [[maybe_unused]] const char* name)
+    {
+#ifdef __APPLE__
+        return sem_close(*semaphore);
+#else
+        return sem_destroy(semaphore);
+#endif
+    }
+
+    static int semaphore_wait(Semaphore* semaphore)
+    {
+        return sem_wait(_native_semaphore(semaphore));
+    }
+
+    static int semaphore_signal(Semaphore* semaphore)
+    {
+        return sem_post(_native_semaphore(semaphore));
+    }
+
+    static int semaphore_try_wait(Semaphore* semaphore)
+    {
+        if (sem_trywait(_native_semaphore(semaphore)) != 0)
+        {
+            return errno;
+        }
+        return 0;
+    }
+
+    static int thread_yield()
+    {
+        return sched_yield();
+    }
+
+private:
+    static sem_t* _native_semaphore(Semaphore* semaphore)
+    {
+#ifdef __APPLE__
+        return *semaphore;
+#else
+        return semaphore;
+#endif
+    }
 };
 
-inline pthread_mutex_t* to_posix_mutex(BaseMutex* mutex)
-{
-    return &static_cast<PosixMutex*>(mutex)->mutex;
-}
-
-inline pthread_cond_t* to_posix_cond(BaseCondVar* cond_var)
-{
-    return &static_cast<PosixCondVar*>(cond_var)->cond_var;
-}
-
-inline sem_t** to_posix_sem(BaseSemaphore* semaphore)
-{
-    return &static_cast<PosixSemaphore*>(semaphore)->semaphore;
-}
-
 #ifdef TWINE_BUILD_WITH_XENOMAI
 
-struct CobaltSemaphore : BaseSemaphore
-{
-    sem_t semaphore;
-};
-
-class CobaltThreadHelper : public BaseThreadHelper
+class CobaltThreadHelper
 {
 public:
-    CobaltThreadHelper() = default;
-    virtual ~CobaltThreadHelper() override {};
-
-    int mutex_create(BaseMutex* mutex, [[maybe_unused]] const char* name) override;
-
-    int mutex_destroy(BaseMutex* mutex) override;
-
-    int mutex_lock(BaseMutex* mutex) override;
-
-    int mutex_unlock(BaseMutex* mutex) override;
-
-    int condition_var_create(BaseCondVar* condition_var, [[maybe_unused]] const char* name) override;
-
-    int condition_var_destroy(BaseCondVar* condition_var) override;
-
-    int condition_wait(BaseCondVar* condition_var, BaseMutex* mutex) override;
-
-    int condition_signal(BaseCondVar* condition_var) override;
-
-    int thread_create(pthread_t* thread, const pthread_attr_t* attributes, void *(*entry_fun) (void *), void* argument) override;
-
-    int thread_join(pthread_t thread, void** return_var) override;
-
-    int semaphore_create(BaseSemaphore* semaphore, [[maybe_unused]] const char* name) override;
-
-    int semaphore_destroy(BaseSemaphore* semaphore, [[maybe_unused]] const char* name) override;
-
-    int semaphore_wait(BaseSemaphore* semaphore) override;
-
-    int semaphore_signal(BaseSemaphore* semaphore) override;
+    using Mutex = pthread_mutex_t;
+    using CondVar = pthread_cond_t;
+    using Semaphore = sem_t;
+
+    static int mutex_create(Mutex* mutex, [[maybe_unused]] const char* name)
+    {
+        return __cobalt_pthread_mutex_init(mutex, nullptr);
+    }
+
+    static int mutex_destroy(Mutex* mutex)
+    {
+        return __cobalt_pthread_mutex_destroy(mutex);
+    }
+
+    static int mutex_lock(Mutex* mutex)
+    {
+        return __cobalt_pthread_mutex_lock(mutex);
+    }
+
+    static int mutex_unlock(Mutex* mutex)
+    {
+        return __cobalt_pthread_mutex_unlock(mutex);
+    }
+
+    static int condition_var_create(CondVar* condition_var, [[maybe_unused]] const char* name)
+    {
+        return __cobalt_pthread_cond_init(condition_var, nullptr);
+    }
+
+    static int condition_var_destroy(CondVar* condition_var)
+    {
+        return __cobalt_pthread_cond_destroy(condition_var);
+    }
+
+    static int condition_wait(CondVar* condition_var, Mutex* mutex)
+    {
+        return __cobalt_pthread_cond_wait(condition_var, mutex);
+    }
+
+    static int condition_timed_wait(CondVar* condition_var, Mutex* mutex, std::chrono::nanoseconds deadline)
+    {
+        // The condition variable uses the realtime clock, while deadline is on the monotonic clock
+        timespec now;
+        __cobalt_clock_gettime(CLOCK_REALTIME, &now);
+        auto remaining = std::max(deadline - current_rt_time(), std::chrono::nanoseconds(0));
+        auto timeout = to_timespec(std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec) + remaining);
+        return __cobalt_pthread_cond_timedwait(condition_var, mutex, &timeout);
+    }
+
+    static int condition_signal(CondVar* condition_var)
+    {
+        return __cobalt_pthread_cond_signal(condition_var);
+    }
+
+    static int thread_create(pthread_t* thread, const pthread_attr_t* attributes, void *(*entry_fun) (void *), void* argument)
+    {
+        return __cobalt_pthread_create(thread, attributes, entry_fun, argument);
+    }
+
+    static int thread_join(pthread_t thread, void** return_var)
+    {
+        return __cobalt_pthread_join(thread, return_var);
+    }
+
+    static int semaphore_create(Semaphore* semaphore, [[maybe_unused]] const char* name)
+    {
+        return __cobalt_sem_init(semaphore, 0, 0);
+    }
+
+    static int semaphore_destroy(Semaphore* semaphore, [[maybe_unused]] const char* name)
+    {
+        return __cobalt_sem_destroy(semaphore);
+    }
+
+    static int semaphore_wait(Semaphore* semaphore)
+    {
+        return __cobalt_sem_wait(semaphore);
+    }
+
+    static int semaphore_signal(Semaphore* semaphore)
+    {
+        return __cobalt_sem_post(semaphore);
+    }
+
+    static int semaphore_try_wait(Semaphore* semaphore)
+    {
+        if (__cobalt_sem_trywait(semaphore) != 0)
+        {
+            return errno;
+        }
+        return 0;
+    }
+
+    static int thread_yield()
+    {
+        return __cobalt_sched_yield();
+    }
 };
 
-inline sem_t* to_cobalt_sem(BaseSemaphore* semaphore)
-{
-    return &static_cast<CobaltSemaphore*>(semaphore)->semaphore;
-}
-
 #endif // TWINE_BUILD_WITH_XENOMAI
 
 #ifdef TWINE_BUILD_WITH_EVL
 
-struct EvlMutex : BaseMutex
+class EvlThreadHelper
 {
-    struct evl_mutex mutex;
+public:
+    using Mutex = struct evl_mutex;
+    using CondVar = struct evl_event;
+    using Semaphore = struct evl_sem;
+
+    static int mutex_create(Mutex* mutex, const char* name)
+    {
+        int fd = evl_new_mutex(mutex, "%s-%d", name, gettid());
+        if (fd < 0)
+        {
+            return fd;
+        }
+        fd = evl_open_mutex(mutex, "%s-%d", name, gettid());
+        if (fd < 0)
+        {
+            return fd;
+        }
+        return 0;
+    }
+
+    static int mutex_destroy(Mutex* mutex)
+    {
+        return evl_close_mutex(mutex);
+    }
+
+    static int mutex_lock(Mutex* mutex)
+    {
+        return evl_lock_mutex(mutex);
+    }
+
+    static int mutex_unlock(Mutex* mutex)
+    {
+        return evl_unlock_mutex(mutex);
+    }
+
+    static int condition_var_create(CondVar* condition_var, const char* name)
+    {
+        int fd = evl_new_event(condition_var, "%s-%d", name, gettid());
+        if (fd < 0)
+        {
+            return fd;
+        }
+        fd = evl_open_event(condition_var, "%s-%d", name, gettid());
+        if (fd < 0)
+        {
+            return fd;
+        }
+        return 0;
+    }
+
+    static int condition_var_destroy(CondVar* condition_var)
+    {
+        return evl_close_event(condition_var);
+    }
+
+    static int condition_wait(CondVar* condition_var, Mutex* mutex)
+    {
+        return evl_wait_event(condition_var, mutex);
+    }
+
+    static int condition_timed_wait(CondVar* condition_var, Mutex* mutex, std::chrono::nanoseconds deadline)
+    {
+        // Events are created on EVL_CLOCK_MONOTONIC, the clock of current_rt_time()
+        auto timeout = to_timespec(deadline);
+        return evl_timedwait_event(condition_var, mutex, &timeout);
+    }
+
+    static int condition_signal(CondVar* condition_var)
+    {
+        return evl_signal_event(condition_var);
+    }
+
+    static int thread_create(pthread_t* thread, const pthread_attr_t* attributes, void *(*entry_fun) (void *), void* argument)
+    {
+        return pthread_create(thread, attributes, entry_fun, argument);
+    }
+
+    static int thread_join(pthread_t thread, void** return_var)
+    {
+        return pthread_join(thread, return_var);
+    }
+
+    static int semaphore_create(Semaphore* semaphore, const char* name)
+    {
+        int fd = evl_new_sem(semaphore, "%s-%d", name, gettid());
+        if (fd < 0)
+        {
+            return fd;
+        }
+        fd = evl_open_sem(semaphore, "%s-%d", name, gettid());
+        if (fd < 0)
+        {
+            return fd;
+        }
+        return 0;
+    }
+
+    static int semaphore_destroy(Semaphore* semaphore, [[maybe_unused]] const char* name)
+    {
+        return evl_close_sem(semaphore);
+    }
+
+    static int semaphore_wait(Semaphore* semaphore)
+    {
+        return evl_get_sem(semaphore);
+    }
+
+    static int semaphore_signal(Semaphore* semaphore)
+    {
+        return evl_put_sem(semaphore);
+    }
+
+    static int semaphore_try_wait(Semaphore* semaphore)
+    {
+        return evl_tryget_sem(semaphore);
+    }
+
+    static int thread_yield()
+    {
+        return evl_yield();
+    }
 };
 
-struct EvlCondVar : BaseCondVar
+#endif // TWINE_BUILD_WITH_EVL
+
+template <ThreadType type>
+struct ThreadHelperSelector;
+
+template <>
+struct ThreadHelperSelector<ThreadType::PTHREAD>
 {
-    struct evl_event cond_var;
+    using Helper = PosixThreadHelper;
 };
 
-struct EvlSemaphore : BaseSemaphore
+#ifdef TWINE_BUILD_WITH_XENOMAI
+template <>
+struct ThreadHelperSelector<ThreadType::COBALT>
 {
-    struct evl_sem semaphore;
+    using Helper = CobaltThreadHelper;
 };
+#endif
 
-class EvlThreadHelper : public BaseThreadHelper
+#ifdef TWINE_BUILD_WITH_EVL
+template <>
+struct ThreadHelperSelector<ThreadType::EVL>
 {
-public:
-    int mutex_create(BaseMutex* mutex, [[maybe_unused]] const char* name) override;
-
-    int mutex_destroy(BaseMutex* mutex) override;
-
-    int mutex_lock(BaseMutex* mutex) override;
-
-    int mutex_unlock(BaseMutex* mutex) override;
-
-    int condition_var_create(BaseCondVar* condition_var, [[maybe_unused]] const char* name) override;
-
-    int condition_var_destroy(BaseCondVar* condition_var) override;
-
-    int condition_wait(BaseCondVar* condition_var, BaseMutex* mutex) override;
-
-    int condition_signal(BaseCondVar* condition_var) override;
-
-    int thread_create(pthread_t* thread, const pthread_attr_t* attributes, void *(*entry_fun) (void *), void* argument) override;
-
-    int thread_join(pthread_t thread, void** return_var = nullptr) override;
-
-    int semaphore_create(BaseSemaphore* semaphore, [[maybe_unused]] const char* name) override;
-
-    int semaphore_destroy(BaseSemaphore* semaphore, [[maybe_unused]] const char* name) override;
-
-    int semaphore_wait(BaseSemaphore* semaphore) override;
-
-    int semaphore_signal(BaseSemaphore* semaphore) override;
+    using Helper = EvlThreadHelper;
 };
+#endif
 
-#endif // TWINE_BUILD_WITH_EVL
+/**
+ * @brief The thread helper for a thread type, only defined for the types twine is built with
+ */
+template <ThreadType type>
+using ThreadHelper = typename ThreadHelperSelector<type>::Helper;
 
 } // namespace twine
 
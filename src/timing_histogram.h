@@ -0,0 +1,195 @@
+/*
+ * Copyright Copyright 2017-2023 Elk Audio AB
+ * Twine is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Fixed size timing histogram that can be written from a realtime thread
+ * @copyright 2017-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef TWINE_TIMING_HISTOGRAM_H
+#define TWINE_TIMING_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+#include "twine/twine.h"
+#include "twine_internal.h"
+
+namespace twine {
+
+/**
+ * @brief Histogram of durations with logarithmic buckets that are each split into
+ *        SUB_BUCKETS linear sub buckets, which bounds the relative error
+ *        of any reported value to 1 / HISTOGRAM_SUB_BUCKETS regardless of magnitude.
+ *        Values are in nanoseconds and can be recorded up to about 2^40 ns (18 min),
+ *        longer durations are clamped.
+ *
+ *        Recording is wait-free and does not allocate, but must only be done from
+ *        one thread at a time. Any other thread can read a summary concurrently,
+ *        which may then be off by the values recorded while reading.
+ */
+class TimingHistogram
+{
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_VALUE_BITS = 40;
+    static constexpr int BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    TimingHistogram() = default;
+
+    /**
+     * @brief Add a duration to the histogram. Negative durations count as 0.
+     * @param duration The duration to record
+     */
+    void record(std::chrono::nanoseconds duration)
+    {
+        auto value = static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0));
+        value = std::min(value, MAX_VALUE);
+
+        _increment(_buckets[bucket_index(value)], 1);
+        _increment(_count, 1);
+        _increment(_sum, value);
+        if (value < _min.load(std::memory_order_relaxed))
+        {
+            _min.store(value, std::memory_order_relaxed);
+        }
+        if (value > _max.load(std::memory_order_relaxed))
+        {
+            _max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Get the number of recorded values, min, max, mean and upper percentiles.
+     *        Safe to call from any thread.
+     */
+    [[nodiscard]] TimingSummary summary() const
+    {
+        TimingSummary summary;
+        summary.count = _count.load(std::memory_order_relaxed);
+        if (summary.count == 0)
+        {
+            return summary;
+        }
+        auto max = _max.load(std::memory_order_relaxed);
+        summary.min = std::chrono::nanoseconds(_min.load(std::memory_order_relaxed));
+        summary.max = std::chrono::nanoseconds(max);
+        summary.mean = std::chrono::nanoseconds(_sum.load(std::memory_order_relaxed) / summary.count);
+        summary.p99 = std::chrono::nanoseconds(std::min(percentile(99.0), max));
+        summary.p999 = std::chrono::nanoseconds(std::min(percentile(99.9), max));
+        return summary;
+    }
+
+    /**
+     * @brief Get the smallest value that is greater than or equal to a given percentage
+     *        of all recorded values, rounded up to the upper limit of its bucket.
+     * @param percent The percentile to get in [0, 100]
+     * @return The value in nanoseconds, or 0 if the histogram is empty
+     */
+    [[nodiscard]] uint64_t percentile(double percent) const
+    {
+        uint64_t total = 0;
+        for (const auto& bucket : _buckets)
+        {
+            total += bucket.load(std::memory_order_relaxed);
+        }
+        if (total == 0)
+        {
+            return 0;
+        }
+        auto threshold = std::max<uint64_t>(static_cast<uint64_t>(static_cast<double>(total) * percent / 100.0 + 0.5), 1);
+        uint64_t accumulated = 0;
+        for (int i = 0; i < BUCKETS; ++i)
+        {
+            accumulated += _buckets[i].load(std::memory_order_relaxed);
+            if (accumulated >= threshold)
+            {
+                return bucket_upper_limit(i);
+            }
+        }
+        return bucket_upper_limit(BUCKETS - 1);
+    }
+
+    /**
+     * @brief Number of values recorded in a single bucket. Safe to call from any thread.
+     */
+    [[nodiscard]] uint64_t bucket_count(int bucket) const
+    {
+        return _buckets[bucket].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the bucket a value in nanoseconds is recorded in
+     */
+    static constexpr int bucket_index(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+        {
+            return static_cast<int>(value);
+        }
+        int magnitude = std::bit_width(value) - 1;
+        int shift = magnitude - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<int>((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    /**
+     * @brief Get the lowest value in nanoseconds that is recorded in a bucket
+     */
+    static constexpr uint64_t bucket_lower_limit(int bucket)
+    {
+        if (bucket < SUB_BUCKETS)
+        {
+            return static_cast<uint64_t>(bucket);
+        }
+        int shift = bucket / SUB_BUCKETS - 1;
+        return static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    }
+
+    /**
+     * @brief Get the highest value in nanoseconds that is recorded in a bucket
+     */
+    static constexpr uint64_t bucket_upper_limit(int bucket)
+    {
+        return bucket_lower_limit(bucket + 1) - 1;
+    }
+
+private:
+    static constexpr uint64_t MAX_VALUE = (uint64_t(1) << MAX_VALUE_BITS) - 1;
+
+    // Single writer, so a read-modify-write operation is not needed
+    static void _increment(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKETS> _buckets{};
+    std::atomic<uint64_t> _count{0};
+    std::atomic<uint64_t> _sum{0};
+    std::atomic<uint64_t> _min{std::numeric_limits<uint64_t>::max()};
+    std::atomic<uint64_t> _max{0};
+};
+
+static_assert(TimingHistogram::bucket_index(TimingHistogram::bucket_lower_limit(100)) == 100);
+static_assert(TimingHistogram::bucket_index(TimingHistogram::bucket_upper_limit(100)) == 100);
+static_assert(TimingHistogram::bucket_index((uint64_t(1) << TimingHistogram::MAX_VALUE_BITS) - 1) == TimingHistogram::BUCKETS - 1);
+
+} // namespace twine
+
+#endif //TWINE_TIMING_HISTOGRAM_H
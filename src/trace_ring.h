@@ -0,0 +1,148 @@
+/*
+ * Copyright Copyright 2017-2023 Elk Audio AB
+ * Twine is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Twine is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with Twine.
+ * If not, see http://www.gnu.org/licenses/ .
+ */
+
+/**
+ * @brief Per thread ring buffer of trace records that can be written from a realtime thread
+ * @copyright 2017-2023 Elk Audio AB, Stockholm
+ */
+
+#ifndef TWINE_TRACE_RING_H
+#define TWINE_TRACE_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "twine/twine.h"
+#include "twine_internal.h"
+
+namespace twine {
+
+// Number of slots per thread, must be a power of 2. One slot is reserved for
+// the record being written, so TRACE_RING_SIZE - 1 records can be drained.
+constexpr uint64_t TRACE_RING_SIZE = 4096;
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0);
+
+#ifdef TWINE_WITH_TRACING
+
+/**
+ * @brief Ring of the last TRACE_RING_SIZE - 1 trace records of a single thread.
+ *        Recording is wait-free and does not allocate or make syscalls, but must
+ *        only be done from one thread at a time. The oldest records are overwritten
+ *        when the ring is full, so that the events leading up to a problem are kept
+ *        even if the ring is not drained.
+ *
+ *        drain() can be called concurrently with recording from a non realtime
+ *        thread. Records that are overwritten while draining are detected and
+ *        skipped instead of being returned torn.
+ */
+class TraceRing
+{
+public:
+    TWINE_DECLARE_NON_COPYABLE(TraceRing);
+
+    /**
+     * @param thread The id the records are tagged with, a worker id or CALLER_TRACE_THREAD
+     */
+    explicit TraceRing(int thread) : _slots(std::make_unique<Slot[]>(TRACE_RING_SIZE)),
+                                     _thread(thread) {}
+
+    /**
+     * @brief Record an event with the current time.
+     * @param event The event to record
+     * @param value Event specific data, see TraceRecord
+     */
+    void record(TraceEvent event, uint32_t value)
+    {
+        auto index = _write_index.load(std::memory_order_relaxed);
+        auto& slot = _slots[index & (TRACE_RING_SIZE - 1)];
+        // Keeps the slot from being written before the previous record is published,
+        // which is what lets drain() detect slots overwritten while it reads them.
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.time.store(current_rt_time().count(), std::memory_order_relaxed);
+        slot.info.store(static_cast<uint64_t>(event) << 32 | value, std::memory_order_relaxed);
+        _write_index.store(index + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Append the records written since the last call to records, oldest first.
+     *        Not safe to call from more than one thread at a time.
+     */
+    void drain(std::vector<TraceRecord>& records)
+    {
+        auto end = _write_index.load(std::memory_order_acquire);
+        // The oldest slot of a full ring is the next one to be written
+        auto begin = std::max(_read_index, end >= TRACE_RING_SIZE ? end - TRACE_RING_SIZE + 1 : 0);
+        auto first = records.size();
+        for (auto i = begin; i < end; ++i)
+        {
+            const auto& slot = _slots[i & (TRACE_RING_SIZE - 1)];
+            auto info = slot.info.load(std::memory_order_relaxed);
+            records.push_back({std::chrono::nanoseconds(slot.time.load(std::memory_order_relaxed)),
+                               static_cast<TraceEvent>(info >> 32),
+                               _thread,
+                               static_cast<uint32_t>(info)});
+        }
+
+        // The writer may have published more records meanwhile, and may be writing one more
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto written = _write_index.load(std::memory_order_relaxed);
+        if (written + 1 > begin + TRACE_RING_SIZE)
+        {
+            auto overwritten = std::min(written + 1 - TRACE_RING_SIZE - begin, end - begin);
+            records.erase(records.begin() + first, records.begin() + first + overwritten);
+        }
+        _read_index = end;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<int64_t>  time{0};
+        std::atomic<uint64_t> info{0};
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    int                     _thread;
+    std::atomic<uint64_t>   _write_index{0};
+    // Only accessed by the thread draining the ring
+    uint64_t                _read_index{0};
+};
+
+#else
+
+/**
+ * @brief Empty stand-in used when twine is built without TWINE_WITH_TRACING,
+ *        recording compiles to nothing.
+ */
+class TraceRing
+{
+public:
+    TWINE_DECLARE_NON_COPYABLE(TraceRing);
+
+    explicit TraceRing(int /*thread*/) {}
+
+    void record(TraceEvent /*event*/, uint32_t /*value*/) {}
+
+    void drain(std::vector<TraceRecord>& /*records*/) {}
+};
+
+#endif
+
+} // namespace twine
+
+#endif //TWINE_TRACE_RING_H
@@ -17,6 +17,11 @@
  * @copyright 2017-2023 Elk Audio AB, Stockholm
  */
 
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <set>
+#include <sstream>
 #include <stdexcept>
 
 #ifdef __SSE__
@@ -106,24 +111,55 @@ void init_xenomai()
 #endif
 }
 
+#ifndef TWINE_WINDOWS_THREADING
+template <ThreadType type>
+std::unique_ptr<WorkerPool> create_worker_pool_impl(int cores,
+                                                    apple::AppleMultiThreadData apple_data,
+                                                    bool disable_denormals,
+                                                    bool break_on_mode_sw,
+                                                    const WorkerPoolOptions& options)
+{
+    switch (options.barrier_type)
+    {
+        case BarrierType::FUTEX:
+#ifdef TWINE_HAS_FUTEX_BARRIER
+            if constexpr (type == ThreadType::PTHREAD)
+            {
+                return std::make_unique<WorkerPoolImpl<type, FutexBarrier>>(cores, apple_data, disable_denormals, break_on_mode_sw, options);
+            }
+#endif
+            // Futexes can not be used with Xenomai/EVL threads, use the closest alternative
+            [[fallthrough]];
+
+        case BarrierType::LOCK_FREE:
+            return std::make_unique<WorkerPoolImpl<type, LockFreeBarrier<type>>>(cores, apple_data, disable_denormals, break_on_mode_sw, options);
+
+        case BarrierType::MUTEX:
+        default:
+            return std::make_unique<WorkerPoolImpl<type>>(cores, apple_data, disable_denormals, break_on_mode_sw, options);
+    }
+}
+#endif
+
 std::unique_ptr<WorkerPool> WorkerPool::create_worker_pool(int cores,
                                                            [[maybe_unused]] apple::AppleMultiThreadData apple_data,
                                                            bool disable_denormals,
-                                                           bool break_on_mode_sw)
+                                                           bool break_on_mode_sw,
+                                                           [[maybe_unused]] const WorkerPoolOptions& options)
 {
 #ifdef TWINE_BUILD_WITH_XENOMAI
     if (running_xenomai_realtime.is_set())
     {
-        return std::make_unique<WorkerPoolImpl<ThreadType::COBALT>>(cores, apple_data, disable_denormals, break_on_mode_sw);
+        return create_worker_pool_impl<ThreadType::COBALT>(cores, apple_data, disable_denormals, break_on_mode_sw, options);
     }
 #elif TWINE_BUILD_WITH_EVL
     if (running_xenomai_realtime.is_set())
     {
-        return std::make_unique<WorkerPoolImpl<ThreadType::EVL>>(cores, apple_data, disable_denormals, break_on_mode_sw);
+        return create_worker_pool_impl<ThreadType::EVL>(cores, apple_data, disable_denormals, break_on_mode_sw, options);
     }
 #endif
 #ifndef TWINE_WINDOWS_THREADING
-    return std::make_unique<WorkerPoolImpl<ThreadType::PTHREAD>>(cores, apple_data, disable_denormals, break_on_mode_sw);
+    return create_worker_pool_impl<ThreadType::PTHREAD>(cores, apple_data, disable_denormals, break_on_mode_sw, options);
 #else
     throw std::runtime_error("Worker pool not enabled for windows");
     return {};
@@ -153,6 +189,13 @@ std::chrono::nanoseconds current_rt_time()
     }
 }
 
+DeadlineParameters deadline_parameters_for_audio_period(int chunk_size, float sample_rate, float budget)
+{
+    auto period = std::chrono::nanoseconds(static_cast<int64_t>(chunk_size * 1'000'000'000.0 / sample_rate));
+    auto runtime = std::chrono::nanoseconds(static_cast<int64_t>(period.count() * std::clamp(budget, 0.0f, 1.0f)));
+    return {runtime, period, period};
+}
+
 void set_flush_denormals_to_zero()
 {
     denormals_intrinsic();
@@ -166,15 +209,101 @@ std::string to_error_string(twine::WorkerPoolStatus status)
             return "Permission denied";
 
         case twine::WorkerPoolStatus::LIMIT_EXCEEDED:
-            return "Thread count limit exceeded";
+            return "Thread count or resource limit exceeded";
 
         default:
             return "Error";
     }
 }
 
+struct ChromeTraceEvent
+{
+    const char* name;
+    const char* phase;
+    const char* argument;
+};
+
+// Indexed by TraceEvent
+constexpr std::array<ChromeTraceEvent, 7> CHROME_TRACE_EVENTS = {{{"barrier_exit", "i", "cycle"},
+                                                                  {"callback", "B", "cycle"},
+                                                                  {"callback", "E", "cycle"},
+                                                                  {"barrier_arrival", "i", "cycle"},
+                                                                  {"release", "i", "workers"},
+                                                                  {"wait_for_workers", "B", nullptr},
+                                                                  {"wait_for_workers", "E", "spun"}}};
+
+std::string to_chrome_trace_json(const std::vector<TraceRecord>& records)
+{
+    // Chrome thread ids must not be negative, this also lists the calling thread first
+    auto tid = [](int thread) {return thread - CALLER_TRACE_THREAD;};
+
+    std::set<int> threads;
+    for (const auto& record : records)
+    {
+        threads.insert(record.thread);
+    }
+
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    const char* separator = "\n";
+    for (auto thread : threads)
+    {
+        auto name = thread == CALLER_TRACE_THREAD ? std::string("Caller") : "Worker " + std::to_string(thread);
+        json << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid(thread)
+             << ",\"args\":{\"name\":\"" << name << "\"}}";
+        separator = ",\n";
+    }
+    for (const auto& record : records)
+    {
+        const auto& event = CHROME_TRACE_EVENTS[static_cast<size_t>(record.event)];
+        // Timestamps are in microseconds
+        json << separator << "{\"name\":\"" << event.name << "\",\"ph\":\"" << event.phase
+             << "\",\"ts\":" << static_cast<double>(record.time.count()) / 1000.0
+             << ",\"pid\":1,\"tid\":" << tid(record.thread);
+        if (event.phase[0] == 'i')
+        {
+            json << ",\"s\":\"t\"";
+        }
+        if (event.argument != nullptr)
+        {
+            json << ",\"args\":{\"" << event.argument << "\":" << record.value << "}";
+        }
+        json << "}";
+        separator = ",\n";
+    }
+    json << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    return json.str();
+}
+
 thread_local int ThreadRtFlag::_instance_counter = 0;
 
+thread_local const WorkerContext* worker_context = nullptr;
+thread_local const std::atomic<uint64_t>* worker_cancelled_cycle = nullptr;
+
+const WorkerContext* current_worker_context()
+{
+    return worker_context;
+}
+
+void set_current_worker_context(const WorkerContext* context, const std::atomic<uint64_t>* cancelled_cycle)
+{
+    worker_context = context;
+    worker_cancelled_cycle = cancelled_cycle;
+}
+
+bool should_abort(std::chrono::nanoseconds margin)
+{
+    if (worker_context == nullptr)
+    {
+        return false;
+    }
+    if (worker_cancelled_cycle && worker_cancelled_cycle->load(std::memory_order_relaxed) == worker_context->cycle)
+    {
+        return true;
+    }
+    return worker_context->deadline.count() != 0 && current_rt_time() + margin >= worker_context->deadline;
+}
+
 ThreadRtFlag::ThreadRtFlag()
 {
     _instance_counter += 1;
@@ -20,8 +20,19 @@
 #ifndef TWINE_TWINE_INTERNAL_H
 #define TWINE_TWINE_INTERNAL_H
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <new>
+
+#include "twine/twine.h"
+
 namespace twine {
 
+// How many times a condition is polled between each check of the spin time
+constexpr int SPIN_POLLS_PER_CLOCK_READ = 16;
+
 class XenomaiRtFlag
 {
 public:
@@ -37,6 +48,92 @@ private:
     static bool _enabled;
 };
 
+/**
+ * @brief Set the context returned by current_worker_context() for the calling thread
+ * @param context Pointer to the worker's context or nullptr when the worker exits
+ * @param cancelled_cycle The number of the last cycle cancelled in the worker's pool,
+ *                        used by should_abort()
+ */
+void set_current_worker_context(const WorkerContext* context, const std::atomic<uint64_t>* cancelled_cycle = nullptr);
+
+/* Size of a cache line, used for keeping data written by different threads apart.
+ * Gcc warns that the value may differ between -mtune flags, which is fine as it
+ * is never part of the public abi. */
+#ifdef __cpp_lib_hardware_interference_size
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+constexpr size_t CACHE_LINE_SIZE = std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+constexpr size_t CACHE_LINE_SIZE = 64;
+#endif
+
+/**
+ * @brief Get a mask selecting the workers with ids in [0, workers)
+ */
+constexpr WorkerMask first_workers_mask(int workers)
+{
+    return workers >= MAX_WORKERS_PER_POOL ? ALL_WORKERS : (WorkerMask(1) << workers) - 1;
+}
+
+/**
+ * @brief Hint to the cpu that the calling thread is busy waiting
+ */
+inline void cpu_pause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+/**
+ * @brief Busy wait until a condition is fulfilled, for as long as the given wait policy allows.
+ * @param policy The wait policy, with WaitPolicy::BLOCK the function returns immediately
+ * @param spin_time The maximum time to spin with WaitPolicy::SPIN_THEN_BLOCK
+ * @param condition Callable returning true when the wait is over
+ * @return true if the condition was fulfilled while spinning, false if the caller needs
+ *         to block in order to wait for it
+ */
+template <typename Condition>
+bool spin_until(WaitPolicy policy, std::chrono::nanoseconds spin_time, Condition condition)
+{
+    if (policy == WaitPolicy::BLOCK)
+    {
+        return false;
+    }
+    auto spin_deadline = current_rt_time() + spin_time;
+    while (true)
+    {
+        for (int i = 0; i < SPIN_POLLS_PER_CLOCK_READ; ++i)
+        {
+            if (condition())
+            {
+                return true;
+            }
+            cpu_pause();
+        }
+        if (policy == WaitPolicy::SPIN_THEN_BLOCK && current_rt_time() > spin_deadline)
+        {
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Convert a time or a duration in nanoseconds to a timespec
+ */
+inline timespec to_timespec(std::chrono::nanoseconds time)
+{
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(time);
+    return {static_cast<time_t>(seconds.count()), static_cast<long>((time - seconds).count())};
+}
+
 #define TWINE_DECLARE_NON_COPYABLE(type) type(const type& other) = delete; \
                                         type& operator=(const type&) = delete;
 
@@ -21,10 +21,13 @@
 #define TWINE_WORKER_POOL_IMPLEMENTATION_H
 
 #include <cassert>
+#include <algorithm>
 #include <atomic>
 #include <memory>
 #include <vector>
 #include <array>
+#include <bit>
+#include <span>
 #include <cstring>
 #include <cerrno>
 #include <stdexcept>
@@ -37,16 +40,33 @@
     #include <evl/xbuf.h>
 #endif
 
+#include <alloca.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifdef __linux__
+    #include <sched.h>
+    #include <sys/syscall.h>
+#endif
+
 #include "apple_threading.h"
 
 #include "twine/twine.h"
+#include "cpu_topology.h"
 #include "thread_helpers.h"
 #include "twine_internal.h"
+#include "job_graph.h"
+#include "parallel_for.h"
+#include "timing_histogram.h"
+#include "trace_ring.h"
+#include "futex_barrier.h"
 
 namespace twine {
-constexpr auto ISOLATED_CPUS_FILE = "/sys/devices/system/cpu/isolated";
 
 template <ThreadType type>
+class BarrierWithTrigger;
+
+template <ThreadType type, typename Barrier = BarrierWithTrigger<type>>
 class WorkerPoolImpl;
 
 void set_flush_denormals_to_zero();
@@ -59,6 +79,8 @@ inline WorkerPoolStatus errno_to_worker_status(int error)
             return WorkerPoolStatus::OK;
 
         case EAGAIN:
+        case EBUSY:
+        case ENOMEM:
             return WorkerPoolStatus::LIMIT_EXCEEDED;
 
         case EPERM:
@@ -84,127 +106,332 @@ inline std::vector<CpuInfo> build_core_list(int start_core, int cores)
 
 /**
  * @brief Reads the configured isolated cores from a given file
- * @param str a string to  read the configuration from
+ * @param str a string to  read the configuration from, in the kernel's cpu list format
  * @return A vector of core ids. Empty if the file doesnt exist or there are no isolated cores
  */
 inline std::vector<int> read_isolated_cores(const std::string& str)
 {
-    try
+    return parse_cpu_list(str);
+}
+
+/**
+ * @brief Get the cpus the process is allowed to run on, as set by its affinity mask
+ *        and its cgroup cpuset
+ * @return The cpu ids in increasing order. Empty if not available on the platform
+ */
+inline std::vector<int> get_allowed_cpus()
+{
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    // The main thread's mask, so that a pinned thread creating the pool does not restrict the workers
+    if (sched_getaffinity(getpid(), sizeof(set), &set) == 0)
     {
-        auto sep = str.find('-');
-        if (sep < std::string::npos)
+        for (int i = 0; i < CPU_SETSIZE; ++i)
         {
-            int first = std::stoi(str.substr(0, sep));
-            int last = std::stoi(str.substr(sep + 1));
-            std::vector<int> list;
-            for (int i = first; i <= last; ++i)
+            if (CPU_ISSET(i, &set))
             {
-                list.push_back(i);
+                cpus.push_back(i);
             }
-            return list;
         }
     }
-    catch (std::exception& e) {/*pass*/}
-    return {};
+#endif
+    return cpus;
+}
+
+#ifdef __linux__
+/**
+ * @brief Switch the calling thread to the SCHED_DEADLINE policy
+ * @param parameters The runtime, deadline and period of the thread
+ * @return 0 if successful, an errno value otherwise. EBUSY means the kernel's
+ *         admission control refused the reservation.
+ */
+inline int set_deadline_scheduling(const DeadlineParameters& parameters)
+{
+    // There is no glibc wrapper for sched_setattr, the layout matches the kernel's struct sched_attr
+    struct
+    {
+        uint32_t size;
+        uint32_t sched_policy;
+        uint64_t sched_flags;
+        int32_t  sched_nice;
+        uint32_t sched_priority;
+        uint64_t sched_runtime;
+        uint64_t sched_deadline;
+        uint64_t sched_period;
+    } attributes = {sizeof(attributes), SCHED_DEADLINE, 0, 0, 0,
+                    static_cast<uint64_t>(parameters.runtime.count()),
+                    static_cast<uint64_t>(parameters.deadline.count()),
+                    static_cast<uint64_t>(parameters.period.count())};
+
+    if (syscall(SYS_sched_setattr, 0, &attributes, 0) != 0)
+    {
+        return errno;
+    }
+    return 0;
+}
+#endif
+
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+// Stack space left untouched below the prefaulted area for the prefaulting function itself
+constexpr size_t STACK_PREFAULT_MARGIN = 16 * 1024;
+
+/**
+ * @brief Write to every page of a region of the calling thread's stack by allocating it
+ *        with alloca(), which makes the kernel map the pages before they are needed.
+ * @param size The number of bytes to prefault below the caller's stack frame
+ */
+[[gnu::noinline]] inline void prefault_stack(size_t size)
+{
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto memory = static_cast<volatile unsigned char*>(alloca(size));
+    for (size_t i = 0; i < size; i += page_size)
+    {
+        memory[i] = 0;
+    }
 }
 
 /**
- * @brief Read the isolated cpus from a file path and populates a vector of CpuInfo objects from it
- * @param cpu_file The file to read cpu data from
- * @param cores The maximum number of cores to use. If that is less than the number of isolated cpu cores
- *              only the first cores will be used
- * @return A std::vector<CpuInfo> with the core ids from the file or std::nullopt if the file is empty
- *         or non-existent
+ * @brief Lock and/or prefault the whole stack of the calling thread
+ * @return 0 if successful, an errno value otherwise
  */
-inline std::optional<std::vector<CpuInfo>> get_isolated_cpus(const std::string& cpu_file, int cores)
+inline int prepare_thread_stack(const WorkerStackOptions& options)
 {
-    std::fstream file;
-    file.open(cpu_file.c_str(), std::ios_base::in);
-    if (file.is_open())
+    void* stack_addr;
+    size_t stack_size;
+#ifdef __APPLE__
+    stack_size = pthread_get_stacksize_np(pthread_self());
+    stack_addr = static_cast<unsigned char*>(pthread_get_stackaddr_np(pthread_self())) - stack_size;
+#else
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(pthread_self(), &attributes) != 0)
+    {
+        return EINVAL;
+    }
+    pthread_attr_getstack(&attributes, &stack_addr, &stack_size);
+    pthread_attr_destroy(&attributes);
+#endif
+
+    if (options.lock && mlock(stack_addr, stack_size) != 0)
     {
-        std::string contents;
-        std::getline(file, contents);
-        auto info = read_isolated_cores(contents);
-        if (info.size() > 0)
+        return errno;
+    }
+    if (options.prefault)
+    {
+        // The stack grows down from stack_addr + stack_size
+        unsigned char current_frame;
+        auto used = static_cast<size_t>(static_cast<unsigned char*>(stack_addr) + stack_size - &current_frame);
+        if (stack_size > used + STACK_PREFAULT_MARGIN)
         {
-            std::vector<CpuInfo> list;
-            for (int i = 0; i < std::min(static_cast<int>(info.size()), cores); ++i)
-            {
-                list.push_back({info.at(i), 0});
-            }
-            return list;
+            prefault_stack(stack_size - used - STACK_PREFAULT_MARGIN);
         }
     }
-    return std::nullopt;
+    return 0;
 }
 
 /**
- * @brief Thread barrier that can be controlled from an external thread
+ * @brief Build the list of cores to run workers on. Isolated and nohz_full cpus are
+ *        shielded from the scheduler, irqs and timer ticks, so if any are configured
+ *        and allowed, only those are used. Otherwise the allowed cpus are used. The
+ *        cores are chosen among those by their topology, see order_cpus_by_topology().
+ * @param cores The maximum number of cores to use
+ * @param sysfs_cpu_path The directory with the isolated and nohz_full cpu lists and the
+ *                       cpu topology
+ * @param allowed_cpus The cpus the process may run on, see get_allowed_cpus().
+ *                     If empty, cores are numbered from 0.
+ * @return A std::vector<CpuInfo> with at most cores entries, with their topology
  */
-template <ThreadType type>
-class BarrierWithTrigger
+inline std::vector<CpuInfo> build_worker_core_list(int cores, const std::string& sysfs_cpu_path, const std::vector<int>& allowed_cpus)
 {
-public:
-    TWINE_DECLARE_NON_COPYABLE(BarrierWithTrigger);
-    /**
-     * @brief Multi-thread barrier with trigger functionality
-     */
-    BarrierWithTrigger()
+    std::vector<int> shielded_cpus;
+    for (auto file : {"/isolated", "/nohz_full"})
     {
-        if constexpr (type == ThreadType::PTHREAD)
-        {
-            _thread_helper = new PosixThreadHelper();
+        auto cpus = read_isolated_cores(read_sysfs_line(sysfs_cpu_path + file).value_or(""));
+        shielded_cpus.insert(shielded_cpus.end(), cpus.begin(), cpus.end());
+    }
+    std::sort(shielded_cpus.begin(), shielded_cpus.end());
+    shielded_cpus.erase(std::unique(shielded_cpus.begin(), shielded_cpus.end()), shielded_cpus.end());
+    if (allowed_cpus.empty() == false)
+    {
+        shielded_cpus.erase(std::remove_if(shielded_cpus.begin(), shielded_cpus.end(), [&](int cpu)
+                            {
+                                return std::find(allowed_cpus.begin(), allowed_cpus.end(), cpu) == allowed_cpus.end();
+                            }), shielded_cpus.end());
+    }
+
+    const auto& cpus = shielded_cpus.empty() ? allowed_cpus : shielded_cpus;
+    if (cpus.empty())
+    {
+        auto list = build_core_list(0, cores);
+        read_cpu_topology(sysfs_cpu_path, list);
+        return list;
+    }
+    std::vector<CpuInfo> candidates;
+    for (auto cpu : cpus)
+    {
+        candidates.push_back({cpu, 0});
+    }
+    read_cpu_topology(sysfs_cpu_path, candidates);
+    auto list = order_cpus_by_topology(std::move(candidates));
+    list.resize(std::min(static_cast<int>(list.size()), cores));
+    return list;
+}
 
-            _semaphores[0] = new PosixSemaphore();
-            _semaphores[1] = new PosixSemaphore();
 
-            _calling_mutex = new PosixMutex();
+typedef void (*CycleCallback)(void* data, int worker_index);
 
-            _calling_cond = new PosixCondVar();
-        }
-        else if constexpr (type == ThreadType::COBALT)
+/**
+ * @brief Work that replaces the workers' own callbacks for a single cycle,
+ *        i.e. when running a job graph. Set before releasing the workers.
+ */
+struct CycleJob
+{
+    CycleCallback callback{nullptr};
+    void*         data{nullptr};
+};
+
+/**
+ * @brief State shared with the workers for every cycle. Written by the thread
+ *        controlling the pool before releasing the workers.
+ */
+struct CycleState
+{
+    CycleJob                 job;
+    WorkerMask               active_workers{ALL_WORKERS};
+    uint64_t                 number{0};
+    std::chrono::nanoseconds release_time{0};
+    std::chrono::nanoseconds deadline{0};
+    std::span<void* const>   worker_data;
+    int                      slot{0};
+    // Only changed while the workers are idle
+    RtConditionVariable*     overrun_notifier{nullptr};
+    std::chrono::nanoseconds overrun_threshold{0};
+};
+
+/**
+ * @brief Histograms of the timings of every cycle of a worker
+ */
+struct WorkerTimingHistograms
+{
+    TimingHistogram wake_latency;
+    TimingHistogram callback_duration;
+    // Written by the thread controlling the pool, so kept off the worker's cache lines
+    alignas(CACHE_LINE_SIZE) TimingHistogram completion_skew;
+
+    [[nodiscard]] WorkerTimings summary() const
+    {
+        return {wake_latency.summary(), callback_duration.summary(), completion_skew.summary()};
+    }
+};
+
+/**
+ * @brief Fixed capacity storage for the workers of a pool, indexed by worker id.
+ *        The workers are constructed in place in one contiguous allocation and never
+ *        move, with every worker starting on a cache line of its own. Slots are
+ *        empty until a worker is added and after it has been removed.
+ */
+template <typename Worker>
+class WorkerArray
+{
+public:
+    TWINE_DECLARE_NON_COPYABLE(WorkerArray);
+
+    WorkerArray() : _slots(std::make_unique<std::optional<Worker>[]>(MAX_WORKERS_PER_POOL)) {}
+
+    ~WorkerArray()
+    {
+        // Stop the workers in the reverse order of adding them
+        for (int id = _size - 1; id >= 0; --id)
         {
-#ifdef TWINE_BUILD_WITH_XENOMAI
-            _thread_helper = new CobaltThreadHelper();
+            _slots[id].reset();
+        }
+    }
 
-            _semaphores[0] = new CobaltSemaphore();
-            _semaphores[1] = new CobaltSemaphore();
+    std::optional<Worker>& operator[](int id)
+    {
+        return _slots[id];
+    }
 
-            _calling_mutex = new PosixMutex();
+    const std::optional<Worker>& operator[](int id) const
+    {
+        return _slots[id];
+    }
 
-            _calling_cond = new PosixCondVar();
-#else
-            assert(false && "Not built with Cobalt support");
-#endif
+    /**
+     * @brief One past the highest id in use
+     */
+    [[nodiscard]] int size() const
+    {
+        return _size;
+    }
+
+    /**
+     * @brief The lowest id not in use, or MAX_WORKERS_PER_POOL if all are taken
+     */
+    [[nodiscard]] int free_id() const
+    {
+        int id = 0;
+        while (id < MAX_WORKERS_PER_POOL && _slots[id].has_value())
+        {
+            ++id;
         }
-        else if constexpr (type == ThreadType::EVL)
+        return id;
+    }
+
+    template <typename... Args>
+    Worker& emplace(int id, Args&&... args)
+    {
+        assert(id >= 0 && id < MAX_WORKERS_PER_POOL && _slots[id].has_value() == false);
+        auto& worker = _slots[id].emplace(std::forward<Args>(args)...);
+        _size = std::max(_size, id + 1);
+        return worker;
+    }
+
+    void reset(int id)
+    {
+        _slots[id].reset();
+        while (_size > 0 && _slots[_size - 1].has_value() == false)
         {
-#ifdef TWINE_BUILD_WITH_EVL
-            _thread_helper = new EvlThreadHelper();
+            --_size;
+        }
+    }
 
-            _semaphores[0] = new EvlSemaphore();
-            _semaphores[1] = new EvlSemaphore();
+private:
+    static_assert(alignof(Worker) >= CACHE_LINE_SIZE, "Workers must not share cache lines");
 
-            _calling_mutex = new EvlMutex();
+    std::unique_ptr<std::optional<Worker>[]> _slots;
+    int                                      _size{0};
+};
 
-            _calling_cond = new EvlCondVar();
-#else
-            assert(false && "Not built with EVL support");
-#endif
-        }
+/**
+ * @brief Thread barrier that can be controlled from an external thread
+ */
+template <ThreadType type>
+class BarrierWithTrigger
+{
+public:
+    TWINE_DECLARE_NON_COPYABLE(BarrierWithTrigger);
 
-        int res = _thread_helper->semaphore_create(_semaphores[0], "/twine-barrier-sem-0");
+    // All threads share the same semaphores, so they can only be released together
+    static constexpr bool SELECTIVE_RELEASE = false;
+    /**
+     * @brief Multi-thread barrier with trigger functionality
+     */
+    BarrierWithTrigger()
+    {
+        int res = Helper::semaphore_create(&_semaphores[0], "/twine-barrier-sem-0");
         if (res != 0)
         {
             throw std::runtime_error(strerror(res));
         }
-        res = _thread_helper->semaphore_create(_semaphores[1], "/twine-barrier-sem-1");
+        res = Helper::semaphore_create(&_semaphores[1], "/twine-barrier-sem-1");
         if (res != 0)
         {
             throw std::runtime_error(strerror(res));
         }
-        _thread_helper->mutex_create(_calling_mutex, "/twine-barrier-mutex");
-        _thread_helper->condition_var_create(_calling_cond, "/twine-barrier-condvar");
+        Helper::mutex_create(&_calling_mutex, "/twine-barrier-mutex");
+        Helper::condition_var_create(&_calling_cond, "/twine-barrier-condvar");
     }
 
     /**
@@ -212,56 +439,75 @@ public:
      */
     ~BarrierWithTrigger()
     {
-        _thread_helper->mutex_destroy(_calling_mutex);
-        _thread_helper->condition_var_destroy(_calling_cond);
-        _thread_helper->semaphore_destroy(_semaphores[0], "/twine-barrier-sem-0");
-        _thread_helper->semaphore_destroy(_semaphores[1], "/twine-barrier-sem-1");
-
-        delete _semaphores[0];
-        delete _semaphores[1];
-        delete _calling_mutex;
-        delete _calling_cond;
-        delete _thread_helper;
+        Helper::mutex_destroy(&_calling_mutex);
+        Helper::condition_var_destroy(&_calling_cond);
+        Helper::semaphore_destroy(&_semaphores[0], "/twine-barrier-sem-0");
+        Helper::semaphore_destroy(&_semaphores[1], "/twine-barrier-sem-1");
     }
 
     /**
      * @brief Wait for signal to finish, called from threads participating on the
      *        barrier
      */
-    void wait()
+    bool wait([[maybe_unused]] int thread_index)
     {
-        _thread_helper->mutex_lock(_calling_mutex);
-        auto active_sem = _semaphores[_active_sem_idx];
+        Helper::mutex_lock(&_calling_mutex);
+        auto active_sem = &_semaphores[_active_sem_idx];
         if (++_no_threads_currently_on_barrier >= _no_threads)
         {
-            _thread_helper->condition_signal(_calling_cond);
+            Helper::condition_signal(&_calling_cond);
         }
-        _thread_helper->mutex_unlock(_calling_mutex);
+        Helper::mutex_unlock(&_calling_mutex);
 
-        _thread_helper->semaphore_wait(active_sem);
+        if (spin_until(_wait_policy, _spin_time, [&]() {return Helper::semaphore_try_wait(active_sem) == 0;}))
+        {
+            return true;
+        }
+        Helper::semaphore_wait(active_sem);
+        return false;
     }
 
     /**
      * @brief Wait for all threads to halt on the barrier, called from a thread
      *        not waiting on the barrier and will block until all threads are
      *        waiting on the barrier.
+     * @return true if the wait ended while spinning, false if the thread had to sleep
      */
-    void wait_for_all()
+    bool wait_for_all()
     {
-        _thread_helper->mutex_lock(_calling_mutex);
-        int current_threads = _no_threads_currently_on_barrier;
+        _trace.record(TraceEvent::WAIT_BEGIN, 0);
+        bool spun = _wait_for_all();
+        _trace.record(TraceEvent::WAIT_END, spun);
+        return spun;
+    }
 
-        if (current_threads == _no_threads)
-        {
-            _thread_helper->mutex_unlock(_calling_mutex);
-            return;
-        }
-        while (current_threads < _no_threads)
+    /**
+     * @brief Wait for all threads to halt on the barrier, but give up at deadline.
+     *        If the wait times out, the threads must be waited for again before
+     *        they are released.
+     * @param deadline In the time base of current_rt_time()
+     * @return true if all threads are waiting on the barrier, false if the wait timed out
+     */
+    bool wait_for_all_until(std::chrono::nanoseconds deadline)
+    {
+        _trace.record(TraceEvent::WAIT_BEGIN, 0);
+        Helper::mutex_lock(&_calling_mutex);
+        bool all_waiting;
+        while ((all_waiting = all_threads_waiting()) == false && current_rt_time() < deadline)
         {
-            _thread_helper->condition_wait(_calling_cond, _calling_mutex);
-            current_threads = _no_threads_currently_on_barrier;
+            Helper::condition_timed_wait(&_calling_cond, &_calling_mutex, deadline);
         }
-        _thread_helper->mutex_unlock(_calling_mutex);
+        Helper::mutex_unlock(&_calling_mutex);
+        _trace.record(TraceEvent::WAIT_END, 0);
+        return all_waiting;
+    }
+
+    /**
+     * @brief Check if all threads are waiting on the barrier, without blocking
+     */
+    bool all_threads_waiting() const
+    {
+        return _no_threads_currently_on_barrier >= _no_threads;
     }
 
     /**
@@ -270,9 +516,30 @@ public:
      */
     void set_no_threads(int threads)
     {
-        _thread_helper->mutex_lock(_calling_mutex);
+        Helper::mutex_lock(&_calling_mutex);
         _no_threads = threads;
-        _thread_helper->mutex_unlock(_calling_mutex);
+        Helper::mutex_unlock(&_calling_mutex);
+    }
+
+    /**
+     * @brief Change which threads the barrier handles, only the number of threads
+     *        matters to this barrier.
+     * @param threads Bit i is set if the thread with index i is on the barrier
+     */
+    void set_threads(WorkerMask threads)
+    {
+        set_no_threads(std::popcount(threads));
+    }
+
+    /**
+     * @brief Set how threads wait on the barrier. Must be set before any thread waits.
+     * @param policy The wait policy for both the threads on the barrier and the caller
+     * @param spin_time The maximum spin time if policy is WaitPolicy::SPIN_THEN_BLOCK
+     */
+    void set_wait_policy(WaitPolicy policy, std::chrono::nanoseconds spin_time)
+    {
+        _wait_policy = policy;
+        _spin_time = spin_time;
     }
 
     /**
@@ -280,44 +547,71 @@ public:
      */
     void release_all()
     {
-        _thread_helper->mutex_lock(_calling_mutex);
+        Helper::mutex_lock(&_calling_mutex);
 
         assert(_no_threads_currently_on_barrier == _no_threads);
         _no_threads_currently_on_barrier = 0;
 
-        auto prev_sem = _semaphores[_active_sem_idx];
+        auto prev_sem = &_semaphores[_active_sem_idx];
         _swap_semaphores();
 
         for (int i = 0; i < _no_threads; ++i)
         {
-            _thread_helper->semaphore_signal(prev_sem);
+            Helper::semaphore_signal(prev_sem);
         }
+        _trace.record(TraceEvent::RELEASE, _no_threads);
+
+        Helper::mutex_unlock(&_calling_mutex);
+    }
 
-        _thread_helper->mutex_unlock(_calling_mutex);
+    /**
+     * @brief Release all threads waiting on the barrier, as this barrier can not
+     *        release only a subset of the threads.
+     */
+    void release([[maybe_unused]] WorkerMask mask)
+    {
+        release_all();
     }
 
-    void release_and_wait()
+    bool release_and_wait([[maybe_unused]] WorkerMask mask = ALL_WORKERS)
     {
-        _thread_helper->mutex_lock(_calling_mutex);
+        if (_wait_policy != WaitPolicy::BLOCK)
+        {
+            release_all();
+            return wait_for_all();
+        }
+        Helper::mutex_lock(&_calling_mutex);
         assert(_no_threads_currently_on_barrier == _no_threads);
         _no_threads_currently_on_barrier = 0;
 
-        auto prev_sem = _semaphores[_active_sem_idx];
+        auto prev_sem = &_semaphores[_active_sem_idx];
         _swap_semaphores();
 
         for (int i = 0; i < _no_threads; ++i)
         {
-            _thread_helper->semaphore_signal(prev_sem);
+            Helper::semaphore_signal(prev_sem);
         }
+        _trace.record(TraceEvent::RELEASE, _no_threads);
+        _trace.record(TraceEvent::WAIT_BEGIN, 0);
 
         int current_threads = _no_threads_currently_on_barrier;
 
         while (current_threads < _no_threads)
         {
-            _thread_helper->condition_wait(_calling_cond, _calling_mutex);
+            Helper::condition_wait(&_calling_cond, &_calling_mutex);
             current_threads = _no_threads_currently_on_barrier;
         }
-        _thread_helper->mutex_unlock(_calling_mutex);
+        Helper::mutex_unlock(&_calling_mutex);
+        _trace.record(TraceEvent::WAIT_END, 0);
+        return false;
+    }
+
+    /**
+     * @brief The trace records of the thread controlling the barrier
+     */
+    TraceRing& trace_ring()
+    {
+        return _trace;
     }
 
 private:
@@ -326,101 +620,421 @@ private:
         _active_sem_idx = 1 - _active_sem_idx;
     }
 
-    BaseThreadHelper* _thread_helper;
+    bool _wait_for_all()
+    {
+        if (spin_until(_wait_policy, _spin_time, [&]() {return _no_threads_currently_on_barrier >= _no_threads;}))
+        {
+            return true;
+        }
+        Helper::mutex_lock(&_calling_mutex);
+        int current_threads = _no_threads_currently_on_barrier;
+
+        if (current_threads == _no_threads)
+        {
+            Helper::mutex_unlock(&_calling_mutex);
+            return false;
+        }
+        while (current_threads < _no_threads)
+        {
+            Helper::condition_wait(&_calling_cond, &_calling_mutex);
+            current_threads = _no_threads_currently_on_barrier;
+        }
+        Helper::mutex_unlock(&_calling_mutex);
+        return false;
+    }
+
+    using Helper = ThreadHelper<type>;
 
-    std::array<BaseSemaphore*, 2> _semaphores;
-    int _active_sem_idx {0};
+    std::array<typename Helper::Semaphore, 2> _semaphores;
 
-    BaseMutex* _calling_mutex;
-    BaseCondVar* _calling_cond;
+    typename Helper::Mutex _calling_mutex;
+    typename Helper::CondVar _calling_cond;
 
-    std::atomic<int> _no_threads_currently_on_barrier{0};
     std::atomic<int> _no_threads{0};
+
+    WaitPolicy _wait_policy{WaitPolicy::BLOCK};
+    std::chrono::nanoseconds _spin_time{DEFAULT_SPIN_TIME};
+
+    // Written by every arriving thread
+    alignas(CACHE_LINE_SIZE) std::atomic<int> _no_threads_currently_on_barrier{0};
+
+    // Written by the calling thread on every release
+    alignas(CACHE_LINE_SIZE) int _active_sem_idx {0};
+    TraceRing _trace{CALLER_TRACE_THREAD};
 };
 
+/**
+ * @brief Barrier with the same interface as BarrierWithTrigger. Threads arrive
+ *        on the barrier with a single atomic increment and every thread waits on
+ *        its own semaphore, so that a subset of the threads can be released while
+ *        the others stay asleep. Semaphores and the mutex are only used when a
+ *        thread actually needs to sleep or be woken up, threads released while
+ *        spinning make no syscalls.
+ */
 template <ThreadType type>
-class WorkerThread
+class LockFreeBarrier
 {
 public:
-    TWINE_DECLARE_NON_COPYABLE(WorkerThread);
+    TWINE_DECLARE_NON_COPYABLE(LockFreeBarrier);
 
-    WorkerThread(BarrierWithTrigger<type>& barrier,
-                 WorkerCallback callback,
-                 void* callback_data,
-                 apple::AppleMultiThreadData& apple_data,
-                 std::atomic_bool& running_flag,
-                 bool disable_denormals,
-                 bool break_on_mode_sw): _barrier(barrier),
-                                         _callback(callback),
-                                         _callback_data(callback_data),
-                                         _apple_data(apple_data),
-                                         _pool_running(running_flag),
-                                         _disable_denormals(disable_denormals),
-                                         _break_on_mode_sw(break_on_mode_sw)
+    static constexpr bool SELECTIVE_RELEASE = true;
 
+    LockFreeBarrier()
     {
-        if constexpr (type == ThreadType::PTHREAD)
+        Helper::mutex_create(&_calling_mutex, "/twine-lf-barrier-mutex");
+        Helper::condition_var_create(&_calling_cond, "/twine-lf-barrier-condvar");
+    }
+
+    ~LockFreeBarrier()
+    {
+        Helper::mutex_destroy(&_calling_mutex);
+        Helper::condition_var_destroy(&_calling_cond);
+        for (int i = 0; i < MAX_WORKERS_PER_POOL; ++i)
         {
-            _thread_helper = new PosixThreadHelper();
+            if (_slots[i].has_semaphore)
+            {
+                Helper::semaphore_destroy(&_slots[i].semaphore, _semaphore_name(i).c_str());
+            }
         }
-        else if constexpr (type == ThreadType::COBALT)
+    }
+
+    /**
+     * @brief Wait for signal to finish, called from threads participating on the
+     *        barrier
+     * @param thread_index The index of the calling thread, unique among the threads
+     *                     on the barrier and less than the number of threads
+     * @return true if the wait ended while spinning, false if the thread had to sleep
+     */
+    bool wait(int thread_index)
+    {
+        assert(thread_index >= 0 && thread_index < MAX_WORKERS_PER_POOL && _slots[thread_index].has_semaphore);
+        auto& slot = _slots[thread_index];
+        // The release count must be read before arriving, as the thread can be
+        // released as soon as the last thread has arrived.
+        auto release_count = slot.release_count.load(std::memory_order_acquire);
+        if (_no_threads_currently_on_barrier.fetch_add(1, std::memory_order_seq_cst) + 1 >= _no_threads.load(std::memory_order_relaxed))
         {
-#ifdef TWINE_BUILD_WITH_XENOMAI
-            _thread_helper = new CobaltThreadHelper();
-#else
-            assert(false && "Not built with Cobalt support");
-#endif
+            _wake_caller();
         }
-        else if constexpr (type == ThreadType::EVL)
+
+        if (spin_until(_wait_policy, _spin_time, [&]() {return slot.release_count.load(std::memory_order_acquire) != release_count;}))
         {
-#ifdef TWINE_BUILD_WITH_EVL
-            _thread_helper = new EvlThreadHelper();
-#else
-            assert(false && "Not built with EVL support");
-#endif
+            return true;
         }
-#if defined(TWINE_APPLE_THREADING) && defined(TWINE_BUILD_WITH_APPLE_COREAUDIO)
 
-        if (__builtin_available(macOS 11.00, *))
+        // The semaphore is only posted to threads announced as sleeping, so a thread
+        // released while spinning never touches it. A post that arrives after the thread
+        // saw the release is consumed by the next sleep, which then goes back to waiting.
+        slot.sleeping.store(true, std::memory_order_seq_cst);
+        while (slot.release_count.load(std::memory_order_seq_cst) == release_count)
         {
-            // The workgroup will be the same for all threads, so it only needs to be fetched once.
-            auto device_workgroup_result = twine::apple::get_device_workgroup(_apple_data.device_name);
+            Helper::semaphore_wait(&slot.semaphore);
+        }
+        slot.sleeping.store(false, std::memory_order_relaxed);
+        return false;
+    }
 
-            if (device_workgroup_result.second != twine::apple::AppleThreadingStatus::OK)
-            {
-                _status = device_workgroup_result.second;
-            }
-            else
-            {
-                _status = apple::AppleThreadingStatus::OK;
-            }
+    /**
+     * @brief Wait for all threads to halt on the barrier, called from a thread
+     *        not waiting on the barrier and will block until all threads are
+     *        waiting on the barrier.
+     * @return true if the wait ended while spinning, false if the thread had to sleep
+     */
+    bool wait_for_all()
+    {
+        _trace.record(TraceEvent::WAIT_BEGIN, 0);
+        bool spun = _wait_for_all();
+        _trace.record(TraceEvent::WAIT_END, spun);
+        return spun;
+    }
 
-            _p_workgroup = device_workgroup_result.first;
+    /**
+     * @brief Wait for all threads to halt on the barrier, but give up at deadline.
+     *        If the wait times out, the threads must be waited for again before
+     *        they are released.
+     * @param deadline In the time base of current_rt_time()
+     * @return true if all threads are waiting on the barrier, false if the wait timed out
+     */
+    bool wait_for_all_until(std::chrono::nanoseconds deadline)
+    {
+        if (_all_threads_on_barrier())
+        {
+            return true;
         }
-        else
+        _trace.record(TraceEvent::WAIT_BEGIN, 0);
+        Helper::mutex_lock(&_calling_mutex);
+        _caller_waiting.store(true, std::memory_order_seq_cst);
+        bool all_waiting;
+        while ((all_waiting = _all_threads_on_barrier()) == false && current_rt_time() < deadline)
         {
-            _status = apple::AppleThreadingStatus::OK;
-            _p_workgroup = nullptr;
+            Helper::condition_timed_wait(&_calling_cond, &_calling_mutex, deadline);
         }
-#endif
+        _caller_waiting.store(false, std::memory_order_relaxed);
+        Helper::mutex_unlock(&_calling_mutex);
+        _trace.record(TraceEvent::WAIT_END, 0);
+        return all_waiting;
     }
 
-    ~WorkerThread()
+    /**
+     * @brief Check if all threads are waiting on the barrier, without blocking
+     */
+    bool all_threads_waiting() const
     {
-        if (_thread_handle)
-        {
-            _thread_helper->thread_join(_thread_handle, nullptr);
-        }
-        delete _thread_helper;
+        return _all_threads_on_barrier();
     }
 
-    int run(int sched_priority, [[maybe_unused]] int cpu_id)
+    /**
+     * @brief Change the number of threads for the barrier to handle, the threads
+     *        will have indices [0, threads).
+     * @param threads
+     */
+    void set_no_threads(int threads)
+    {
+        assert(threads <= MAX_WORKERS_PER_POOL);
+        set_threads(first_workers_mask(threads));
+    }
+
+    /**
+     * @brief Change which threads the barrier handles. Creates a semaphore the first
+     *        time a thread index is used, so not safe to call from a realtime thread.
+     *        Throws std::runtime_error if a semaphore can not be created.
+     * @param threads Bit i is set if the thread with index i is on the barrier
+     */
+    void set_threads(WorkerMask threads)
+    {
+        for (int i = 0; i < MAX_WORKERS_PER_POOL; ++i)
+        {
+            auto& slot = _slots[i];
+            if ((threads & (WorkerMask(1) << i)) && slot.has_semaphore == false)
+            {
+                int res = Helper::semaphore_create(&slot.semaphore, _semaphore_name(i).c_str());
+                if (res != 0)
+                {
+                    throw std::runtime_error(strerror(res));
+                }
+                slot.has_semaphore = true;
+            }
+        }
+        _threads = threads;
+        _no_threads.store(std::popcount(threads), std::memory_order_seq_cst);
+    }
+
+    /**
+     * @brief Set how threads wait on the barrier. Must be set before any thread waits.
+     * @param policy The wait policy for both the threads on the barrier and the caller
+     * @param spin_time The maximum spin time if policy is WaitPolicy::SPIN_THEN_BLOCK
+     */
+    void set_wait_policy(WaitPolicy policy, std::chrono::nanoseconds spin_time)
+    {
+        _wait_policy = policy;
+        _spin_time = spin_time;
+    }
+
+    /**
+     * @brief Release the threads selected by mask, the other threads stay on the
+     *        barrier without waking up. Must only be called when all threads are
+     *        waiting on the barrier.
+     * @param mask Bit i selects the thread with index i
+     */
+    void release(WorkerMask mask)
+    {
+        assert(_all_threads_on_barrier());
+        mask &= _threads;
+        int released = std::popcount(mask);
+        // Threads left on the barrier are still counted as arrived
+        _no_threads_currently_on_barrier.store(std::popcount(_threads) - released, std::memory_order_relaxed);
+
+        for (int i = 0; mask != 0; ++i, mask >>= 1)
+        {
+            if (mask & 1u)
+            {
+                // Incrementing the release count also publishes everything written before the release
+                auto& slot = _slots[i];
+                slot.release_count.fetch_add(1, std::memory_order_seq_cst);
+                if (slot.sleeping.load(std::memory_order_seq_cst))
+                {
+                    Helper::semaphore_signal(&slot.semaphore);
+                }
+            }
+        }
+        _trace.record(TraceEvent::RELEASE, released);
+    }
+
+    /**
+     * @brief Release all threads waiting on the barrier.
+     */
+    void release_all()
+    {
+        release(ALL_WORKERS);
+    }
+
+    bool release_and_wait(WorkerMask mask = ALL_WORKERS)
+    {
+        release(mask);
+        return wait_for_all();
+    }
+
+    /**
+     * @brief The trace records of the thread controlling the barrier
+     */
+    TraceRing& trace_ring()
+    {
+        return _trace;
+    }
+
+private:
+    bool _all_threads_on_barrier() const
+    {
+        return _no_threads_currently_on_barrier.load(std::memory_order_seq_cst) >= _no_threads.load(std::memory_order_relaxed);
+    }
+
+    bool _wait_for_all()
+    {
+        if (_all_threads_on_barrier() || spin_until(_wait_policy, _spin_time, [&]() {return _all_threads_on_barrier();}))
+        {
+            return true;
+        }
+
+        Helper::mutex_lock(&_calling_mutex);
+        _caller_waiting.store(true, std::memory_order_seq_cst);
+        while (_all_threads_on_barrier() == false)
+        {
+            Helper::condition_wait(&_calling_cond, &_calling_mutex);
+        }
+        _caller_waiting.store(false, std::memory_order_relaxed);
+        Helper::mutex_unlock(&_calling_mutex);
+        return false;
+    }
+
+    void _wake_caller()
+    {
+        // Pairs with the store in wait_for_all(), either the caller sees all threads
+        // on the barrier before sleeping or it is seen waiting here.
+        if (_caller_waiting.load(std::memory_order_seq_cst))
+        {
+            Helper::mutex_lock(&_calling_mutex);
+            Helper::condition_signal(&_calling_cond);
+            Helper::mutex_unlock(&_calling_mutex);
+        }
+    }
+
+    static std::string _semaphore_name(int thread_index)
+    {
+        return "/twine-lf-barrier-sem-" + std::to_string(thread_index);
+    }
+
+    using Helper = ThreadHelper<type>;
+
+    struct alignas(CACHE_LINE_SIZE) ThreadSlot
+    {
+        std::atomic<uint32_t>       release_count{0};
+        std::atomic_bool            sleeping{false};
+        typename Helper::Semaphore  semaphore{};
+        bool                        has_semaphore{false};
+    };
+
+    std::array<ThreadSlot, MAX_WORKERS_PER_POOL> _slots;
+    WorkerMask _threads{0};
+
+    typename Helper::Mutex _calling_mutex;
+    typename Helper::CondVar _calling_cond;
+
+    std::atomic<int> _no_threads{0};
+
+    WaitPolicy _wait_policy{WaitPolicy::BLOCK};
+    std::chrono::nanoseconds _spin_time{DEFAULT_SPIN_TIME};
+
+    // Written by every arriving thread and by the calling thread, read by the last one to arrive
+    alignas(CACHE_LINE_SIZE) std::atomic<int> _no_threads_currently_on_barrier{0};
+    std::atomic_bool _caller_waiting{false};
+
+    alignas(CACHE_LINE_SIZE) TraceRing _trace{CALLER_TRACE_THREAD};
+};
+
+template <ThreadType type, typename Barrier = BarrierWithTrigger<type>>
+class WorkerThread
+{
+public:
+    TWINE_DECLARE_NON_COPYABLE(WorkerThread);
+
+    WorkerThread(Barrier& barrier,
+                 int index,
+                 WorkerCallback callback,
+                 void* callback_data,
+                 const CycleState& cycle,
+                 apple::AppleMultiThreadData& apple_data,
+                 std::atomic_bool& running_flag,
+                 const std::atomic<uint64_t>& cancelled_cycle,
+                 bool disable_denormals,
+                 bool break_on_mode_sw,
+                 bool record_timings,
+                 const WorkerStackOptions& stack_options,
+                 const WorkerHooks& hooks): _barrier(barrier),
+                                       _index(index),
+                                       _cycle(cycle),
+                                       _apple_data(apple_data),
+                                       _pool_running(running_flag),
+                                       _cancelled_cycle(cancelled_cycle),
+                                       _disable_denormals(disable_denormals),
+                                       _break_on_mode_sw(break_on_mode_sw),
+                                       _record_timings(record_timings),
+                                       _stack_options(stack_options),
+                                       _hooks(hooks),
+                                       _callback(callback),
+                                       _callback_data(callback_data),
+                                       _finished_cycle(cycle.number),
+                                       _trace(index)
+    {
+        if (_record_timings)
+        {
+            _timings = std::make_unique<WorkerTimingHistograms>();
+        }
+#if defined(TWINE_APPLE_THREADING) && defined(TWINE_BUILD_WITH_APPLE_COREAUDIO)
+
+        if (__builtin_available(macOS 11.00, *))
+        {
+            // The workgroup will be the same for all threads, so it only needs to be fetched once.
+            auto device_workgroup_result = twine::apple::get_device_workgroup(_apple_data.device_name);
+
+            if (device_workgroup_result.second != twine::apple::AppleThreadingStatus::OK)
+            {
+                _status = device_workgroup_result.second;
+            }
+            else
+            {
+                _status = apple::AppleThreadingStatus::OK;
+            }
+
+            _p_workgroup = device_workgroup_result.first;
+        }
+        else
+        {
+            _status = apple::AppleThreadingStatus::OK;
+            _p_workgroup = nullptr;
+        }
+#endif
+    }
+
+    ~WorkerThread()
+    {
+        if (_thread_handle)
+        {
+            Helper::thread_join(_thread_handle, nullptr);
+        }
+        if (_stack_mapping)
+        {
+            munmap(_stack_mapping, _stack_mapping_size);
+        }
+    }
+
+    int run(int sched_priority, [[maybe_unused]] int cpu_id)
     {
         if ( (sched_priority < 0) || (sched_priority > 100) )
         {
             return EINVAL;
         }
         _priority = sched_priority;
+        _cpu_id = cpu_id;
         // TODO - Why was rt_params moved to only apple on te apple branch?
         struct sched_param rt_params = {.sched_priority = sched_priority};
         pthread_attr_t task_attributes;
@@ -430,24 +1044,75 @@ public:
         pthread_attr_setinheritsched(&task_attributes, PTHREAD_EXPLICIT_SCHED);
         pthread_attr_setschedpolicy(&task_attributes, SCHED_FIFO);
         pthread_attr_setschedparam(&task_attributes, &rt_params);
-        auto res = 0;
+        auto res = _set_stack_attributes(&task_attributes);
 #if !defined __APPLE__ && !defined TWINE_WINDOWS_THREADING
         cpu_set_t cpus;
         CPU_ZERO(&cpus);
         CPU_SET(cpu_id, &cpus);
-        res = pthread_attr_setaffinity_np(&task_attributes, sizeof(cpu_set_t), &cpus);
+        if (res == 0)
+        {
+            res = pthread_attr_setaffinity_np(&task_attributes, sizeof(cpu_set_t), &cpus);
+        }
 #endif
         if (res == 0)
         {
-            res = _thread_helper->thread_create(&_thread_handle, &task_attributes, &_worker_function, this);
+            res = Helper::thread_create(&_thread_handle, &task_attributes, &_worker_function, this);
         }
         pthread_attr_destroy(&task_attributes);
         return res;
     }
 
+    /**
+     * @brief Start the worker thread with the SCHED_DEADLINE policy. The policy is set
+     *        by the thread itself before it first waits on the barrier, check the
+     *        result with setup_status() once the worker is idle.
+     * @return 0 if the thread was created, an errno value otherwise
+     */
+    int run_deadline([[maybe_unused]] const DeadlineParameters& parameters)
+    {
+#ifdef __linux__
+        _deadline = parameters;
+        _cpu_id = -1;
+        pthread_attr_t task_attributes;
+        pthread_attr_init(&task_attributes);
+        pthread_attr_setdetachstate(&task_attributes, PTHREAD_CREATE_JOINABLE);
+
+        // The kernel refuses to admit deadline threads that are restricted to a subset of the cpus,
+        // so the worker must not inherit the affinity of a pinned thread creating it
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (auto cpu : get_allowed_cpus())
+        {
+            CPU_SET(cpu, &cpus);
+        }
+        auto res = _set_stack_attributes(&task_attributes);
+        if (res == 0)
+        {
+            res = pthread_attr_setaffinity_np(&task_attributes, sizeof(cpu_set_t), &cpus);
+        }
+        if (res == 0)
+        {
+            res = Helper::thread_create(&_thread_handle, &task_attributes, &_worker_function, this);
+        }
+        pthread_attr_destroy(&task_attributes);
+        return res;
+#else
+        return EINVAL;
+#endif
+    }
+
+    /**
+     * @brief The result of preparing the stack and setting the scheduling policy from
+     *        the worker thread, 0 if successful or an errno value otherwise.
+     */
+    int setup_status() const
+    {
+        return _setup_status;
+    }
+
     static void* _worker_function(void* data)
     {
-        reinterpret_cast<WorkerThread<type>*>(data)->_internal_worker_function();
+        reinterpret_cast<WorkerThread<type, Barrier>*>(data)->_internal_worker_function();
         return nullptr;
     }
 
@@ -457,6 +1122,56 @@ public:
     }
 
 private:
+    // Applies the stack options to the attributes of a new worker thread, returns 0 or an errno value
+    int _set_stack_attributes(pthread_attr_t* attributes)
+    {
+#ifdef __linux__
+        if (_stack_options.huge_pages)
+        {
+            size_t size = _stack_options.size;
+            if (size == 0)
+            {
+                pthread_attr_getstacksize(attributes, &size);
+            }
+            size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+            auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            // Reserve room for a guard page of normal size below the stack and for aligning
+            // the stack to a huge page, the parts not used for the stack stay inaccessible
+            auto mapping_size = size + HUGE_PAGE_SIZE + page_size;
+            auto mapping = mmap(nullptr, mapping_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (mapping == MAP_FAILED)
+            {
+                return ENOMEM;
+            }
+            _stack_mapping = mapping;
+            _stack_mapping_size = mapping_size;
+
+            auto stack_start = (reinterpret_cast<uintptr_t>(mapping) + page_size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+            auto stack = mmap(reinterpret_cast<void*>(stack_start), size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_FIXED | MAP_HUGETLB, -1, 0);
+            if (stack == MAP_FAILED)
+            {
+                // No huge pages reserved, fall back to transparent huge pages
+                stack = mmap(reinterpret_cast<void*>(stack_start), size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_FIXED, -1, 0);
+                if (stack == MAP_FAILED)
+                {
+                    return ENOMEM;
+                }
+                madvise(stack, size, MADV_HUGEPAGE);
+            }
+            _stack = stack;
+            _stack_size = size;
+            return pthread_attr_setstack(attributes, _stack, _stack_size);
+        }
+#endif
+        if (_stack_options.size > 0)
+        {
+            return pthread_attr_setstacksize(attributes, _stack_options.size);
+        }
+        return 0;
+    }
+
     void _internal_worker_function()
     {
         // Signal that this is a realtime thread
@@ -484,18 +1199,85 @@ private:
 #endif
 #ifdef TWINE_APPLE_THREADING
         _init_apple_thread();
+#endif
+        if (_stack_options.prefault || _stack_options.lock)
+        {
+            _setup_status = prepare_thread_stack(_stack_options);
+        }
+        _context.worker_index = _index;
+        set_current_worker_context(&_context, &_cancelled_cycle);
+        // Before switching to deadline scheduling, so that on_start does not use up the worker's runtime
+        if (_hooks.on_start)
+        {
+            _hooks.on_start(_callback_data);
+        }
+#ifdef __linux__
+        if (_deadline.has_value() && _setup_status == 0)
+        {
+            _setup_status = set_deadline_scheduling(_deadline.value());
+        }
 #endif
         while (true)
         {
-            _barrier.wait();
+            _trace.record(TraceEvent::BARRIER_ARRIVAL, _context.cycle);
+            _count_wakeup(_barrier.wait(_index));
             if (_pool_running.load() == false || _thread_running.load() == false)
             {
                 // condition checked when coming out of wait as we might want to exit immediately here
                 break;
             }
-            _callback(_callback_data);
+            _apply_pending_callback();
+            if constexpr (Barrier::SELECTIVE_RELEASE == false)
+            {
+                // Released along with the selected workers, go straight back to the barrier
+                if ((_cycle.active_workers & (WorkerMask(1) << _index)) == 0)
+                {
+                    continue;
+                }
+            }
+            _context.cycle = _cycle.number;
+            _context.release_time = _cycle.release_time;
+            _context.deadline = _cycle.deadline;
+            _context.slot = _cycle.slot;
+            _trace.record(TraceEvent::BARRIER_EXIT, _context.cycle);
+
+            std::chrono::nanoseconds start_time{0};
+            if (_record_timings)
+            {
+                start_time = current_rt_time();
+            }
+            _trace.record(TraceEvent::CALLBACK_BEGIN, _context.cycle);
+            if (_cycle.job.callback)
+            {
+                _cycle.job.callback(_cycle.job.data, _index);
+            }
+            else if (_index < static_cast<int>(_cycle.worker_data.size()))
+            {
+                _callback(_cycle.worker_data[_index]);
+            }
+            else
+            {
+                _callback(_callback_data);
+            }
+            if (_context.deadline.count() != 0)
+            {
+                _check_overrun(current_rt_time() - _context.deadline);
+            }
+            _finished_cycle.store(_context.cycle, std::memory_order_release);
+            _trace.record(TraceEvent::CALLBACK_END, _context.cycle);
+            if (_record_timings)
+            {
+                _completion_time = current_rt_time();
+                _timings->wake_latency.record(start_time - _cycle.release_time);
+                _timings->callback_duration.record(_completion_time - start_time);
+            }
         }
 
+        if (_hooks.on_stop)
+        {
+            _hooks.on_stop(_callback_data);
+        }
+        set_current_worker_context(nullptr);
 #if defined(TWINE_APPLE_THREADING) && defined(TWINE_BUILD_WITH_APPLE_COREAUDIO)
         apple::leave_workgroup_if_needed(&_join_token, _p_workgroup);
 #endif
@@ -528,42 +1310,126 @@ private:
     }
 #endif
 
-    friend class WorkerPoolImpl<ThreadType::PTHREAD>;
-    friend class WorkerPoolImpl<ThreadType::COBALT>;
-    friend class WorkerPoolImpl<ThreadType::EVL>;
+    template <ThreadType, typename>
+    friend class WorkerPoolImpl;
 
     void _stop_thread()
     {
         _thread_running.store(false);
 
-        _barrier.release_all();
+        _barrier.release(WorkerMask(1) << _index);
     }
 
-    BarrierWithTrigger<type>&   _barrier;
-    pthread_t                   _thread_handle{0};
-    WorkerCallback              _callback;
-    void*                       _callback_data;
+    /* The callback is replaced through a sequence lock so that it can be done from a
+     * realtime thread while the worker is running. The worker picks up the new callback
+     * the next time it is released, or the time after if it is being replaced right then. */
+    void _set_callback(WorkerCallback callback, void* callback_data)
+    {
+        auto sequence = _callback_sequence.load(std::memory_order_relaxed);
+        _callback_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _pending_callback.store(callback, std::memory_order_relaxed);
+        _pending_callback_data.store(callback_data, std::memory_order_relaxed);
+        _callback_sequence.store(sequence + 2, std::memory_order_release);
+    }
 
+    void _apply_pending_callback()
+    {
+        auto sequence = _callback_sequence.load(std::memory_order_acquire);
+        if (sequence == _applied_callback_sequence || (sequence & 1u))
+        {
+            return;
+        }
+        auto callback = _pending_callback.load(std::memory_order_relaxed);
+        auto callback_data = _pending_callback_data.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_callback_sequence.load(std::memory_order_relaxed) == sequence)
+        {
+            _callback = callback;
+            _callback_data = callback_data;
+            _applied_callback_sequence = sequence;
+        }
+    }
+
+    void _check_overrun(std::chrono::nanoseconds lateness)
+    {
+        if (lateness <= std::chrono::nanoseconds(0))
+        {
+            return;
+        }
+        _overruns.store(_overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (_cycle.overrun_notifier && lateness >= _cycle.overrun_threshold)
+        {
+            _cycle.overrun_notifier->notify();
+        }
+    }
+
+    void _count_wakeup(bool spun)
+    {
+        // Only ever written from the worker thread, so no read-modify-write is needed
+        auto& counter = spun ? _spin_wakeups : _blocking_wakeups;
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    using Helper = ThreadHelper<type>;
+
+    /* Fields are grouped by which thread writes them while the worker is running,
+     * so that the worker and the thread controlling the pool do not invalidate each
+     * other's cache lines every cycle. These are only read once the worker is started. */
+    Barrier&                    _barrier;
+    int                         _index;
+    const CycleState&           _cycle;
     apple::AppleMultiThreadData& _apple_data;
+    const std::atomic_bool&     _pool_running;
+    const std::atomic<uint64_t>& _cancelled_cycle;
+    bool                        _disable_denormals;
+    bool                        _break_on_mode_sw;
+    bool                        _record_timings;
+    int                         _priority {0};
+    int                         _cpu_id {0};
+    pthread_t                   _thread_handle{0};
+    std::optional<DeadlineParameters> _deadline;
+    WorkerStackOptions          _stack_options;
+    // Only set if the stack is allocated by the worker instead of by pthreads.
+    // The mapping includes an inaccessible guard page below the stack.
+    void*                       _stack_mapping {nullptr};
+    size_t                      _stack_mapping_size {0};
+    void*                       _stack {nullptr};
+    size_t                      _stack_size {0};
+    WorkerHooks                 _hooks;
 
 #ifdef TWINE_APPLE_THREADING
     os_workgroup_join_token_s   _join_token;
     os_workgroup_t              _p_workgroup;
 #endif
 
-    std::atomic<apple::AppleThreadingStatus> _status {apple::AppleThreadingStatus::OK};
-
-    const std::atomic_bool&     _pool_running;
-    std::atomic_bool            _thread_running {true};
+    // Written by the thread controlling the pool
+    alignas(CACHE_LINE_SIZE) std::atomic_bool _thread_running {true};
+    std::atomic<uint32_t>       _callback_sequence {0};
+    std::atomic<WorkerCallback> _pending_callback {nullptr};
+    std::atomic<void*>          _pending_callback_data {nullptr};
 
-    bool                        _disable_denormals;
-    int                         _priority {0};
-    bool                        _break_on_mode_sw;
+    // Written by the worker thread
+    alignas(CACHE_LINE_SIZE) WorkerCallback _callback;
+    void*                       _callback_data;
+    uint32_t                    _applied_callback_sequence {0};
+    WorkerContext               _context;
+    std::atomic<uint64_t>       _spin_wakeups {0};
+    std::atomic<uint64_t>       _blocking_wakeups {0};
+    std::atomic<uint64_t>       _overruns {0};
+    // Read by the thread controlling the pool while the worker is running
+    std::atomic<uint64_t>       _finished_cycle;
+    // Read by the thread controlling the pool once the worker is back on the barrier
+    std::chrono::nanoseconds    _completion_time {0};
+    std::atomic<apple::AppleThreadingStatus> _status {apple::AppleThreadingStatus::OK};
+    int                         _setup_status {0};
+    TraceRing                   _trace;
 
-    BaseThreadHelper*           _thread_helper;
+    // Only allocated if timings are recorded, as the histograms are many times larger than the rest of the worker
+    std::unique_ptr<WorkerTimingHistograms> _timings;
 };
 
-template <ThreadType type>
+template <ThreadType type, typename Barrier>
 class WorkerPoolImpl : public WorkerPool
 {
 public:
@@ -572,26 +1438,16 @@ public:
     explicit WorkerPoolImpl(int cores,
                             [[maybe_unused]] apple::AppleMultiThreadData apple_data,
                             bool disable_denormals,
-                            bool break_on_mode_sw) : _disable_denormals(disable_denormals),
+                            bool break_on_mode_sw,
+                            const WorkerPoolOptions& options = WorkerPoolOptions()) : _disable_denormals(disable_denormals),
                                                      _break_on_mode_sw(break_on_mode_sw),
+                                                     _record_timings(options.record_timings),
+                                                     _stack_options(options.stack),
                                                      _apple_data(apple_data)
     {
-#ifdef TWINE_BUILD_WITH_EVL
-        // EVL supports isolated cpus, if that is enabled we need to assign workers only to those cores
-        // If isolated cpus is not enabled we simply start counting from 0
-        if constexpr (type == ThreadType::EVL)
-        {
-            _cores = get_isolated_cpus(ISOLATED_CPUS_FILE, cores).value_or(build_core_list(0, cores));
-        }
-        else
-        {
-            _cores = build_core_list(0, cores);
-        }
-#else
-        _cores = build_core_list(0, cores);
-
-#endif
-
+        _cores = build_worker_core_list(cores, options.sysfs_cpu_path, get_allowed_cpus());
+        _barrier.set_wait_policy(options.wait_policy, options.spin_time);
+        _parallel_for.set_participants(1);
     }
 
     ~WorkerPoolImpl() override
@@ -604,9 +1460,344 @@ public:
     std::pair<WorkerPoolStatus, apple::AppleThreadingStatus> add_worker(WorkerCallback worker_cb,
                                                                         void* worker_data,
                                                                         int sched_priority = DEFAULT_SCHED_PRIORITY,
-                                                                        std::optional<int> cpu_id = std::nullopt) override
+                                                                        std::optional<int> cpu_id = std::nullopt,
+                                                                        const WorkerHooks& hooks = WorkerHooks()) override
+    {
+        return _add_worker(worker_cb, worker_data, sched_priority, cpu_id, nullptr, hooks);
+    }
+
+    std::pair<WorkerPoolStatus, apple::AppleThreadingStatus> add_deadline_worker(WorkerCallback worker_cb,
+                                                                                 void* worker_data,
+                                                                                 const DeadlineParameters& parameters,
+                                                                                 const WorkerHooks& hooks = WorkerHooks()) override
+    {
+#ifdef __linux__
+        if constexpr (type == ThreadType::PTHREAD)
+        {
+            if (parameters.runtime < std::chrono::microseconds(1) || parameters.runtime > parameters.deadline ||
+                parameters.deadline > parameters.period)
+            {
+                return {WorkerPoolStatus::INVALID_ARGUMENTS, apple::AppleThreadingStatus::EMPTY};
+            }
+            return _add_worker(worker_cb, worker_data, 0, std::nullopt, &parameters, hooks);
+        }
+#endif
+        return {WorkerPoolStatus::INVALID_ARGUMENTS, apple::AppleThreadingStatus::EMPTY};
+    }
+
+    WorkerPoolStatus remove_worker(int worker_id) override
+    {
+        if (_valid_worker_id(worker_id) == false)
+        {
+            return WorkerPoolStatus::INVALID_ARGUMENTS;
+        }
+        // Finish an outstanding cycle before the mask changes, its timings
+        // are lost once _remove_worker() clears the active workers.
+        wait_for_workers_idle();
+        _remove_worker(worker_id);
+        return WorkerPoolStatus::OK;
+    }
+
+    WorkerPoolStatus set_worker_callback(int worker_id, WorkerCallback worker_cb, void* worker_data) override
+    {
+        if (_valid_worker_id(worker_id) == false || worker_cb == nullptr)
+        {
+            return WorkerPoolStatus::INVALID_ARGUMENTS;
+        }
+        _workers[worker_id]->_set_callback(worker_cb, worker_data);
+        return WorkerPoolStatus::OK;
+    }
+
+    void wait_for_workers_idle() override
+    {
+        _count_caller_wakeup(_barrier.wait_for_all());
+        _finish_cycle();
+    }
+
+    bool is_idle() const override
+    {
+        return _barrier.all_threads_waiting();
+    }
+
+    bool try_wait() override
+    {
+        // Polling never waits, so it is not counted in the wait statistics
+        if (_barrier.all_threads_waiting() == false)
+        {
+            return false;
+        }
+        _finish_cycle();
+        return true;
+    }
+
+    WaitResult wait_until(std::chrono::nanoseconds deadline) override
+    {
+        // Counted as wait_for_workers_idle() would, a timed wait never spins but
+        // finds the workers idle without sleeping if they have already finished
+        bool already_idle = _barrier.all_threads_waiting();
+        if (already_idle == false && _barrier.wait_for_all_until(deadline) == false)
+        {
+            return WaitResult::TIMED_OUT;
+        }
+        _count_caller_wakeup(already_idle);
+        _finish_cycle();
+        return WaitResult::IDLE;
+    }
+
+    WorkerMask running_workers() const override
+    {
+        WorkerMask running = 0;
+        for (int id = 0; id < _workers.size(); ++id)
+        {
+            if (_is_active(id) && _workers[id]->_finished_cycle.load(std::memory_order_acquire) != _cycle.number)
+            {
+                running |= WorkerMask(1) << id;
+            }
+        }
+        return running;
+    }
+
+    void wakeup_workers() override
+    {
+        wakeup_workers(ALL_WORKERS);
+    }
+
+    void wakeup_and_wait() override
+    {
+        wakeup_and_wait(ALL_WORKERS);
+    }
+
+    void wakeup_workers(WorkerMask mask) override
+    {
+        _wakeup_workers(mask, {});
+    }
+
+    void wakeup_and_wait(WorkerMask mask) override
+    {
+        _wakeup_and_wait(mask, {});
+    }
+
+    void wakeup_workers(std::span<void* const> worker_data) override
+    {
+        _wakeup_workers(ALL_WORKERS, worker_data);
+    }
+
+    void wakeup_and_wait(std::span<void* const> worker_data) override
+    {
+        _wakeup_and_wait(ALL_WORKERS, worker_data);
+    }
+
+    int wakeup_pipelined() override
+    {
+        if (_pipeline_running)
+        {
+            wait_for_workers_idle();
+        }
+        _cycle.slot = _pipeline_slot;
+        _wakeup_workers(ALL_WORKERS, {});
+        _pipeline_running = true;
+        _pipeline_slot = (_pipeline_slot + 1) % PIPELINE_SLOTS;
+        return _pipeline_slot;
+    }
+
+    int finish_pipeline() override
+    {
+        if (_pipeline_running == false)
+        {
+            return -1;
+        }
+        wait_for_workers_idle();
+        _pipeline_running = false;
+        // Cycles outside of the pipelined mode always run on slot 0, and a new pipeline starts on it
+        int slot = _cycle.slot;
+        _cycle.slot = 0;
+        _pipeline_slot = 0;
+        return slot;
+    }
+
+    void set_cycle_deadline(std::chrono::nanoseconds deadline) override
+    {
+        _next_deadline = deadline;
+    }
+
+    void cancel_cycle() override
+    {
+        _cancelled_cycle.store(_cycle.number, std::memory_order_relaxed);
+    }
+
+    void set_overrun_notification(RtConditionVariable* cond_var, std::chrono::nanoseconds threshold) override
+    {
+        _cycle.overrun_notifier = cond_var;
+        _cycle.overrun_threshold = threshold;
+    }
+
+    void set_caller_callback(WorkerCallback caller_cb, void* caller_data) override
+    {
+        _caller_callback = caller_cb;
+        _caller_callback_data = caller_data;
+    }
+
+    std::vector<CpuInfo> core_info() const override
+    {
+        return _cores;
+    }
+
+    std::pair<WorkerPoolStatus, int> add_job(WorkerCallback job_cb,
+                                             void* job_data,
+                                             const std::vector<int>& predecessors = {}) override
     {
-        std::vector<CpuInfo>::iterator core_info;
+        return _job_graph.add_job(job_cb, job_data, predecessors);
+    }
+
+    void clear_jobs() override
+    {
+        _job_graph.clear();
+    }
+
+    void run_job_graph() override
+    {
+        if (_job_graph.size() == 0)
+        {
+            return;
+        }
+        _job_graph.prepare();
+        if (_no_workers == 0)
+        {
+            _job_graph.run_ready_jobs();
+            return;
+        }
+        _cycle.job = {&_run_job_graph, &_job_graph};
+        _cycle.active_workers = ALL_WORKERS;
+        _start_cycle();
+        _barrier.release_all();
+        // The calling thread takes part instead of just waiting for the workers
+        _job_graph.run_ready_jobs();
+        _count_caller_wakeup(_barrier.wait_for_all());
+        _finish_cycle();
+        _cycle.job = {};
+    }
+
+    void parallel_for(int begin, int end, int grain, RangeCallback fn, void* data) override
+    {
+        if (grain <= 0 || end <= begin)
+        {
+            return;
+        }
+        _parallel_for.prepare(begin, end, grain, fn, data);
+        if (_no_workers == 0)
+        {
+            _parallel_for.run_chunks(CALLER_INDEX);
+            return;
+        }
+        _cycle.job = {&_run_parallel_for, &_parallel_for};
+        _cycle.active_workers = ALL_WORKERS;
+        _start_cycle();
+        _barrier.release_all();
+        // The calling thread takes part instead of just waiting for the workers
+        _parallel_for.run_chunks(CALLER_INDEX);
+        _count_caller_wakeup(_barrier.wait_for_all());
+        _finish_cycle();
+        _cycle.job = {};
+    }
+
+    std::vector<WorkerTimings> worker_timings() const override
+    {
+        std::vector<WorkerTimings> timings;
+        timings.reserve(_workers.size());
+        for (int id = 0; id < _workers.size(); ++id)
+        {
+            timings.push_back(_workers[id] && _workers[id]->_timings ? _workers[id]->_timings->summary() : WorkerTimings());
+        }
+        return timings;
+    }
+
+    std::vector<uint64_t> worker_overruns() const override
+    {
+        std::vector<uint64_t> overruns(_workers.size(), 0);
+        for (int id = 0; id < _workers.size(); ++id)
+        {
+            if (_workers[id].has_value())
+            {
+                overruns[id] = _workers[id]->_overruns.load(std::memory_order_relaxed);
+            }
+        }
+        return overruns;
+    }
+
+    std::vector<TraceRecord> drain_trace() override
+    {
+        std::vector<TraceRecord> records;
+        _barrier.trace_ring().drain(records);
+        for (int id = 0; id < _workers.size(); ++id)
+        {
+            if (_workers[id].has_value())
+            {
+                _workers[id]->_trace.drain(records);
+            }
+        }
+        std::stable_sort(records.begin(), records.end(), [](const auto& lhs, const auto& rhs) {return lhs.time < rhs.time;});
+        return records;
+    }
+
+    WaitStatistics wait_statistics() const override
+    {
+        WaitStatistics stats;
+        for (int id = 0; id < _workers.size(); ++id)
+        {
+            const auto& worker = _workers[id];
+            if (worker.has_value() == false)
+            {
+                continue;
+            }
+            stats.worker_spin_wakeups += worker->_spin_wakeups.load(std::memory_order_relaxed);
+            stats.worker_blocking_wakeups += worker->_blocking_wakeups.load(std::memory_order_relaxed);
+        }
+        stats.caller_spin_wakeups = _caller_spin_wakeups.load(std::memory_order_relaxed);
+        stats.caller_blocking_wakeups = _caller_blocking_wakeups.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    void _wakeup_workers(WorkerMask mask, std::span<void* const> worker_data)
+    {
+        _cycle.active_workers = mask;
+        _cycle.worker_data = worker_data;
+        _start_cycle();
+        _barrier.release(mask);
+    }
+
+    void _wakeup_and_wait(WorkerMask mask, std::span<void* const> worker_data)
+    {
+        _cycle.active_workers = mask;
+        _cycle.worker_data = worker_data;
+        _start_cycle();
+        if (_caller_callback)
+        {
+            _barrier.release(mask);
+            _caller_callback(_caller_callback_data);
+            _count_caller_wakeup(_barrier.wait_for_all());
+        }
+        else
+        {
+            _count_caller_wakeup(_barrier.release_and_wait(mask));
+        }
+        _finish_cycle();
+    }
+
+    std::pair<WorkerPoolStatus, apple::AppleThreadingStatus> _add_worker(WorkerCallback worker_cb,
+                                                                         void* worker_data,
+                                                                         int sched_priority,
+                                                                         std::optional<int> cpu_id,
+                                                                         const DeadlineParameters* deadline,
+                                                                         const WorkerHooks& hooks)
+    {
+        // Reuse the lowest id left by a removed worker
+        int id = _workers.free_id();
+        if (id >= MAX_WORKERS_PER_POOL)
+        {
+            return {WorkerPoolStatus::LIMIT_EXCEEDED, apple::AppleThreadingStatus::EMPTY};
+        }
+        auto core_info = _cores.end();
         if (cpu_id.has_value())
         {
             auto core = std::find_if(_cores.begin(), _cores.end(), [&](auto& i){return i.id == cpu_id.value();});
@@ -616,89 +1807,192 @@ public:
             }
             core_info = core;
         }
-        else
+        else if (deadline == nullptr)
         {
-            // If no core is specified, pick the first core with the least usage
-            auto core = std::min_element(_cores.begin(), _cores.end(),
-                                         [](auto& lhs, auto& rhs){return lhs.workers < rhs.workers;});
-            core_info = core;
+            // If no core is specified, pick the least used core based on the topology.
+            // Deadline workers are not pinned and don't count towards any core.
+            core_info = pick_worker_core(_cores);
         }
 
-        auto worker = std::make_unique<WorkerThread<type>>(_barrier,
-                                                           worker_cb,
-                                                           worker_data,
-                                                           _apple_data,
-                                                           _running,
-                                                           _disable_denormals,
-                                                           _break_on_mode_sw);
-        _barrier.set_no_threads(_no_workers + 1);
-
-        core_info->workers++;
+        auto& worker = _workers.emplace(id,
+                                        _barrier,
+                                        id,
+                                        worker_cb,
+                                        worker_data,
+                                        _cycle,
+                                        _apple_data,
+                                        _running,
+                                        _cancelled_cycle,
+                                        _disable_denormals,
+                                        _break_on_mode_sw,
+                                        _record_timings,
+                                        _stack_options,
+                                        hooks);
+        auto worker_mask = _worker_mask | (WorkerMask(1) << id);
+        _barrier.set_threads(worker_mask);
+
+        if (core_info != _cores.end())
+        {
+            core_info->workers++;
+        }
 
-        auto res = errno_to_worker_status(worker->run(sched_priority, core_info->id));
+        auto res = errno_to_worker_status(deadline != nullptr ? worker.run_deadline(*deadline) :
+                                                                worker.run(sched_priority, core_info->id));
         if (res == WorkerPoolStatus::OK)
         {
             // Wait until the thread is idle to avoid synchronisation issues
             _no_workers++;
-            _workers.push_back(std::move(worker));
+            _worker_mask = worker_mask;
             _barrier.wait_for_all();
+            _parallel_for.set_participants(_workers.size() + 1);
 
             // Currently, potential failures in worker threads happen only during initialisation.
             // If that changes in the future, checking the status only on start will not suffice.
-            auto& w = _workers.back();
-            if (w->init_status() != apple::AppleThreadingStatus::OK)
+            if (worker.init_status() != apple::AppleThreadingStatus::OK)
             {
-                auto status = w->init_status();
+                auto status = worker.init_status();
 
                 // On failure, the thread is removed and discarded.
                 // The Twine host needs to decide if this is considered recoverable, or if it should exit.
-                w->_stop_thread();
-
-                _no_workers--;
-                _barrier.set_no_threads(_no_workers);
-                core_info->workers--;
-
-                _workers.pop_back();
+                _remove_worker(id);
 
                 return {WorkerPoolStatus::POOL_ERROR, status};
             }
+            if (worker.setup_status() != 0)
+            {
+                // Locking the stack or setting the scheduling policy failed, e.g. from deadline admission control
+                auto status = errno_to_worker_status(worker.setup_status());
+                _remove_worker(id);
+                return {status, apple::AppleThreadingStatus::OK};
+            }
         }
         else
         {
-            _barrier.set_no_threads(_no_workers);
+            // The thread was never started, so there is nothing to join
+            _workers.reset(id);
+            _barrier.set_threads(_worker_mask);
+            if (core_info != _cores.end())
+            {
+                core_info->workers--;
+            }
         }
 
         return {res, apple::AppleThreadingStatus::OK};
     }
 
-    void wait_for_workers_idle() override
+    bool _valid_worker_id(int worker_id) const
     {
+        return worker_id >= 0 && worker_id < _workers.size() && _workers[worker_id].has_value();
+    }
+
+    void _remove_worker(int worker_id)
+    {
+        auto& worker = _workers[worker_id];
+        // Barriers that can not release single threads will release all workers,
+        // none of them should run their callbacks.
+        _cycle.active_workers = 0;
+        worker->_stop_thread();
+        _worker_mask &= ~(WorkerMask(1) << worker_id);
+        _barrier.set_threads(_worker_mask);
+        _no_workers--;
+
+        auto core = std::find_if(_cores.begin(), _cores.end(), [&](auto& i){return i.id == worker->_cpu_id;});
+        if (core != _cores.end())
+        {
+            core->workers--;
+        }
+        // Joins the worker thread
+        _workers.reset(worker_id);
         _barrier.wait_for_all();
+        _parallel_for.set_participants(_workers.size() + 1);
     }
 
-    void wakeup_workers() override
+    // Workers use their own index + 1 in ParallelFor, index 0 is the calling thread
+    static constexpr int CALLER_INDEX = 0;
+
+    static void _run_parallel_for(void* data, int worker_index)
     {
-        _barrier.release_all();
+        static_cast<ParallelFor*>(data)->run_chunks(worker_index + 1);
     }
 
-    void wakeup_and_wait() override
+    void _start_cycle()
     {
-        _barrier.release_and_wait();
+        _cycle.number++;
+        _cycle.release_time = current_rt_time();
+        _cycle.deadline = _next_deadline;
+        _next_deadline = std::chrono::nanoseconds(0);
+        _cycle_pending = _record_timings;
     }
 
-    std::vector<CpuInfo> core_info() const override
+    void _finish_cycle()
     {
-        return _cores;
+        if (_cycle_pending == false)
+        {
+            return;
+        }
+        _cycle_pending = false;
+        auto first_completion = std::chrono::nanoseconds::max();
+        for (int id = 0; id < _workers.size(); ++id)
+        {
+            if (_is_active(id))
+            {
+                first_completion = std::min(first_completion, _workers[id]->_completion_time);
+            }
+        }
+        for (int id = 0; id < _workers.size(); ++id)
+        {
+            if (_is_active(id))
+            {
+                _workers[id]->_timings->completion_skew.record(_workers[id]->_completion_time - first_completion);
+            }
+        }
     }
 
-private:
+    bool _is_active(int worker_id) const
+    {
+        return _workers[worker_id].has_value() && (_cycle.active_workers & (WorkerMask(1) << worker_id));
+    }
+
+    void _count_caller_wakeup(bool spun)
+    {
+        auto& counter = spun ? _caller_spin_wakeups : _caller_blocking_wakeups;
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    static void _run_job_graph(void* data, int /*worker_index*/)
+    {
+        static_cast<JobGraph<ThreadHelper<type>>*>(data)->run_ready_jobs();
+    }
+
+    // Read by the workers after every wakeup, but only written when the pool is destroyed
     std::atomic_bool            _running{true};
+    // Only written when a cycle is cancelled, starts out not matching any cycle
+    std::atomic<uint64_t>       _cancelled_cycle{~uint64_t(0)};
     int                         _no_workers{0};
+    WorkerMask                  _worker_mask{0};
+    WorkerCallback              _caller_callback{nullptr};
+    void*                       _caller_callback_data{nullptr};
     std::vector<CpuInfo>        _cores;
     bool                        _disable_denormals;
     bool                        _break_on_mode_sw;
-    BarrierWithTrigger<type>    _barrier;
-    std::vector<std::unique_ptr<WorkerThread<type>>> _workers;
+    bool                        _record_timings;
+    WorkerStackOptions          _stack_options;
+
+    JobGraph<ThreadHelper<type>> _job_graph;
+    ParallelFor                 _parallel_for;
+
+    // Written by the calling thread every cycle, the barrier and workers start on cache lines of their own
+    alignas(CACHE_LINE_SIZE) CycleState _cycle;
+    std::chrono::nanoseconds    _next_deadline{0};
+    bool                        _cycle_pending{false};
+    bool                        _pipeline_running{false};
+    // The slot owned by the calling thread in pipelined mode
+    int                         _pipeline_slot{0};
+    std::atomic<uint64_t>       _caller_spin_wakeups{0};
+    std::atomic<uint64_t>       _caller_blocking_wakeups{0};
+
+    Barrier                     _barrier;
+    WorkerArray<WorkerThread<type, Barrier>> _workers;
 
     apple::AppleMultiThreadData _apple_data;
 };
@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "twine/twine.h"
+#include "twine_internal.h"
+
+/*
+ * Benchmarks of the twine primitives, run with twine_benchmarks. Results are
+ * printed as JSON unless another --benchmark_format is given, so that runs
+ * against different twine versions can be compared with Google Benchmark's
+ * compare.py or any JSON diff.
+ */
+
+constexpr int MIN_WORKERS = 1;
+constexpr int MAX_WORKERS = 8;
+constexpr int WAKE_LATENCY_CYCLES = 1000;
+
+namespace {
+
+// Pool benchmark arguments: workers, wait policy, barrier type
+constexpr int WORKERS_ARG = 0;
+constexpr int WAIT_POLICY_ARG = 1;
+constexpr int BARRIER_ARG = 2;
+
+// Keeps the workers' own data from sharing cache lines
+struct alignas(twine::CACHE_LINE_SIZE) WorkerCounter
+{
+    uint64_t count{0};
+};
+
+void worker_function(void* data)
+{
+    static_cast<WorkerCounter*>(data)->count++;
+}
+
+twine::WorkerPoolOptions pool_options(const benchmark::State& state, bool record_timings)
+{
+    twine::WorkerPoolOptions options;
+    options.wait_policy = static_cast<twine::WaitPolicy>(state.range(WAIT_POLICY_ARG));
+    options.barrier_type = static_cast<twine::BarrierType>(state.range(BARRIER_ARG));
+    options.record_timings = record_timings;
+    return options;
+}
+
+int pool_cores()
+{
+    return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+}
+
+std::unique_ptr<twine::WorkerPool> create_pool(benchmark::State& state,
+                                               const twine::WorkerPoolOptions& options,
+                                               std::vector<WorkerCounter>& counters)
+{
+    twine::apple::AppleMultiThreadData apple_data{};
+    auto pool = twine::WorkerPool::create_worker_pool(pool_cores(), apple_data, true, false, options);
+    for (auto& counter : counters)
+    {
+        auto res = pool->add_worker(worker_function, &counter);
+        if (res.first != twine::WorkerPoolStatus::OK)
+        {
+            state.SkipWithError(twine::to_error_string(res.first).c_str());
+            return nullptr;
+        }
+    }
+    return pool;
+}
+
+void pool_arguments(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->ArgNames({"workers", "wait_policy", "barrier"});
+    benchmark->ArgsProduct({benchmark::CreateRange(MIN_WORKERS, MAX_WORKERS, 2),
+                            {static_cast<int64_t>(twine::WaitPolicy::BLOCK), static_cast<int64_t>(twine::WaitPolicy::SPIN_THEN_BLOCK)},
+                            {static_cast<int64_t>(twine::BarrierType::MUTEX),
+                             static_cast<int64_t>(twine::BarrierType::LOCK_FREE),
+                             static_cast<int64_t>(twine::BarrierType::FUTEX)}});
+}
+
+double to_ns(std::chrono::nanoseconds time)
+{
+    return static_cast<double>(time.count());
+}
+
+} // namespace
+
+/**
+ * Time for waking up all workers and waiting for them to finish a cycle that
+ * does close to no work, i.e. the synchronisation overhead of a cycle.
+ */
+static void BM_WakeupAndWait(benchmark::State& state)
+{
+    std::vector<WorkerCounter> counters(state.range(WORKERS_ARG));
+    auto pool = create_pool(state, pool_options(state, false), counters);
+    if (pool == nullptr)
+    {
+        return;
+    }
+    for (auto _ : state)
+    {
+        pool->wakeup_and_wait();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WakeupAndWait)->Apply(pool_arguments)->UseRealTime();
+
+/**
+ * Time from the workers being released until they start running their callbacks,
+ * as recorded by the pool. Reported as counters in ns, the worst worker counts.
+ */
+static void BM_WakeToStartLatency(benchmark::State& state)
+{
+    std::vector<WorkerCounter> counters(state.range(WORKERS_ARG));
+    auto pool = create_pool(state, pool_options(state, true), counters);
+    if (pool == nullptr)
+    {
+        return;
+    }
+    for (auto _ : state)
+    {
+        for (int i = 0; i < WAKE_LATENCY_CYCLES; ++i)
+        {
+            pool->wakeup_and_wait();
+        }
+    }
+
+    twine::TimingSummary worst;
+    for (const auto& timings : pool->worker_timings())
+    {
+        worst.mean = std::max(worst.mean, timings.wake_latency.mean);
+        worst.p99 = std::max(worst.p99, timings.wake_latency.p99);
+        worst.max = std::max(worst.max, timings.wake_latency.max);
+    }
+    state.counters["wake_latency_mean_ns"] = to_ns(worst.mean);
+    state.counters["wake_latency_p99_ns"] = to_ns(worst.p99);
+    state.counters["wake_latency_max_ns"] = to_ns(worst.max);
+    state.SetItemsProcessed(state.iterations() * WAKE_LATENCY_CYCLES);
+}
+BENCHMARK(BM_WakeToStartLatency)->Apply(pool_arguments)->UseRealTime();
+
+/**
+ * Cost of creating a pool and starting its workers. Destroying the pool is not
+ * included in the time.
+ */
+static void BM_PoolConstruction(benchmark::State& state)
+{
+    twine::apple::AppleMultiThreadData apple_data{};
+    twine::WorkerPoolOptions options;
+    std::vector<WorkerCounter> counters(state.range(0));
+    for (auto _ : state)
+    {
+        auto pool = twine::WorkerPool::create_worker_pool(pool_cores(), apple_data, true, false, options);
+        for (auto& counter : counters)
+        {
+            pool->add_worker(worker_function, &counter);
+        }
+        state.PauseTiming();
+        pool.reset();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_PoolConstruction)->ArgName("workers")->Arg(0)->RangeMultiplier(2)->Range(MIN_WORKERS, MAX_WORKERS)->UseRealTime();
+
+/**
+ * Cost of RtConditionVariable::notify() on the realtime side, with a thread
+ * waiting on the condition variable.
+ */
+static void BM_ConditionVariableNotify(benchmark::State& state)
+{
+    auto cond_var = twine::RtConditionVariable::create_rt_condition_variable();
+    std::atomic_bool running = true;
+    std::thread waiter([&]()
+    {
+        while (running.load())
+        {
+            cond_var->wait();
+        }
+    });
+
+    for (auto _ : state)
+    {
+        cond_var->notify();
+    }
+
+    running = false;
+    cond_var->notify();
+    waiter.join();
+}
+BENCHMARK(BM_ConditionVariableNotify)->UseRealTime();
+
+/**
+ * Time from RtConditionVariable::notify() until the waiting thread wakes up.
+ */
+static void BM_ConditionVariableNotifyToWake(benchmark::State& state)
+{
+    auto cond_var = twine::RtConditionVariable::create_rt_condition_variable();
+    std::atomic_bool running = true;
+    std::atomic_bool woken = false;
+    std::atomic<int64_t> notify_time{0};
+    std::atomic<int64_t> latency{0};
+
+    std::thread waiter([&]()
+    {
+        while (true)
+        {
+            cond_var->wait();
+            if (running.load() == false)
+            {
+                break;
+            }
+            latency.store(twine::current_rt_time().count() - notify_time.load());
+            woken.store(true, std::memory_order_release);
+        }
+    });
+
+    for (auto _ : state)
+    {
+        woken.store(false);
+        notify_time.store(twine::current_rt_time().count());
+        cond_var->notify();
+        while (woken.load(std::memory_order_acquire) == false)
+        {
+            std::this_thread::yield();
+        }
+        state.SetIterationTime(static_cast<double>(latency.load()) / 1e9);
+    }
+
+    running = false;
+    cond_var->notify();
+    waiter.join();
+}
+BENCHMARK(BM_ConditionVariableNotifyToWake)->UseManualTime();
+
+int main(int argc, char** argv)
+{
+    // Default to JSON output, an explicit --benchmark_format takes precedence
+    std::vector<char*> args(argv, argv + argc);
+    std::string json_format = "--benchmark_format=json";
+    if (std::none_of(args.begin(), args.end(), [](const char* arg) {return std::strncmp(arg, "--benchmark_format", 18) == 0;}))
+    {
+        args.push_back(json_format.data());
+    }
+    int arg_count = static_cast<int>(args.size());
+    benchmark::Initialize(&arg_count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(arg_count, args.data()))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
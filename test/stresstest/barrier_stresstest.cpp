@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+#include <pthread.h>
+
+#define TWINE_EXPOSE_INTERNALS 1
+#include "twine/twine.h"
+#include "worker_pool_implementation.h"
+
+/*
+ * Tool for comparing the release and wait round-trip time of the
+ * barrier implementations available for regular posix threads.
+ */
+
+constexpr int DEFAULT_THREADS = 4;
+constexpr int DEFAULT_ITERATIONS = 100000;
+
+using TimeStamp = std::chrono::nanoseconds;
+
+struct RoundTripStats
+{
+    TimeStamp min_time{std::numeric_limits<int64_t>::max()};
+    TimeStamp max_time{0};
+    TimeStamp total_time{0};
+};
+
+void set_rt_priority(int priority)
+{
+    if (priority > 0)
+    {
+        struct sched_param rt_params = {.sched_priority = priority};
+        auto res = pthread_setschedparam(pthread_self(), SCHED_FIFO, &rt_params);
+        if (res != 0)
+        {
+            std::cout << "Failed to set thread priority: " << strerror(res) << std::endl;
+        }
+    }
+}
+
+template <typename Barrier>
+void barrier_worker(Barrier& barrier, std::atomic_bool& running, int priority, int index)
+{
+    set_rt_priority(priority);
+    while (true)
+    {
+        barrier.wait(index);
+        if (running.load() == false)
+        {
+            break;
+        }
+    }
+}
+
+template <typename Barrier>
+RoundTripStats run_benchmark(int threads, int iterations, int priority, int spin_time_us)
+{
+    Barrier barrier;
+    std::atomic_bool running = true;
+    std::vector<std::thread> workers;
+
+    if (spin_time_us > 0)
+    {
+        barrier.set_wait_policy(twine::WaitPolicy::SPIN_THEN_BLOCK, std::chrono::microseconds(spin_time_us));
+    }
+    barrier.set_no_threads(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back(barrier_worker<Barrier>, std::ref(barrier), std::ref(running), priority, i);
+    }
+    barrier.wait_for_all();
+
+    RoundTripStats stats;
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto start_time = twine::current_rt_time();
+        barrier.release_and_wait();
+        auto round_trip = twine::current_rt_time() - start_time;
+
+        stats.min_time = std::min(stats.min_time, round_trip);
+        stats.max_time = std::max(stats.max_time, round_trip);
+        stats.total_time += round_trip;
+    }
+
+    running = false;
+    barrier.release_all();
+    for (auto& t : workers)
+    {
+        t.join();
+    }
+    return stats;
+}
+
+void print_stats(const std::string& name, const RoundTripStats& stats, int iterations)
+{
+    std::cout << name << ": avg: " << stats.total_time.count() / iterations / 1000.0 <<
+                         " us, min: " << stats.min_time.count() / 1000.0 <<
+                         " us, max: " << stats.max_time.count() / 1000.0 << " us" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = DEFAULT_THREADS;
+    int iters = DEFAULT_ITERATIONS;
+    int priority = 0;
+    int spin_time = 0;
+    signed char c;
+
+    while ((c = getopt(argc, argv, "w:i:p:s:")) != -1)
+    {
+        switch (c)
+        {
+            case 'w':
+                threads = atoi(optarg);
+                break;
+            case 'i':
+                iters = atoi(optarg);
+                break;
+            case 'p':
+                priority = atoi(optarg);
+                break;
+            case 's':
+                spin_time = atoi(optarg);
+                break;
+            case '?':
+                std::cout << "Options are: -w[n of waiting threads], -i[n of iterations], -p[SCHED_FIFO priority, 0 for none], "
+                             "-s[spin time in us before blocking, 0 for always blocking]" << std::endl;
+                abort();
+
+            default:
+                abort();
+        }
+    }
+
+    std::cout << "Running " << iters << " release and wait round-trips with " << threads << " threads" << std::endl;
+    set_rt_priority(priority);
+
+    print_stats("Semaphore barrier", run_benchmark<twine::BarrierWithTrigger<twine::ThreadType::PTHREAD>>(threads, iters, priority, spin_time), iters);
+    print_stats("Lock-free barrier", run_benchmark<twine::LockFreeBarrier<twine::ThreadType::PTHREAD>>(threads, iters, priority, spin_time), iters);
+#ifdef TWINE_HAS_FUTEX_BARRIER
+    print_stats("Futex barrier    ", run_benchmark<twine::FutexBarrier>(threads, iters, priority, spin_time), iters);
+#endif
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <pthread.h>
+
+#include "twine/twine.h"
+#include "timing_histogram.h"
+
+/*
+ * Tool for measuring the cycle time of a WorkerPool, i.e. the time from waking
+ * up the workers until they are all idle again, when the workers do close to no
+ * work. This is dominated by the synchronisation inside the pool, which makes
+ * any cache line contention between workers and the calling thread visible as
+ * the number of workers grows.
+ */
+
+constexpr int DEFAULT_ITERATIONS = 100000;
+constexpr int DEFAULT_CORES = 8;
+constexpr std::array DEFAULT_WORKER_COUNTS = {8, 16};
+
+// Keeps the benchmark's own per worker data from sharing cache lines
+struct alignas(twine::CACHE_LINE_SIZE) WorkerCounter
+{
+    uint64_t count{0};
+};
+
+void worker_function(void* data)
+{
+    auto counter = static_cast<WorkerCounter*>(data);
+    counter->count++;
+}
+
+void set_rt_priority(int priority)
+{
+    if (priority > 0)
+    {
+        struct sched_param rt_params = {.sched_priority = priority};
+        auto res = pthread_setschedparam(pthread_self(), SCHED_FIFO, &rt_params);
+        if (res != 0)
+        {
+            std::cout << "Failed to set thread priority: " << strerror(res) << std::endl;
+        }
+    }
+}
+
+bool run_benchmark(const std::string& name, twine::WorkerPoolOptions options, int workers, int cores, int iterations)
+{
+    twine::apple::AppleMultiThreadData apple_data{};
+    auto pool = twine::WorkerPool::create_worker_pool(cores, apple_data, true, false, options);
+    std::vector<WorkerCounter> counters(workers);
+    for (auto& counter : counters)
+    {
+        auto res = pool->add_worker(worker_function, &counter);
+        if (res.first != twine::WorkerPoolStatus::OK)
+        {
+            std::cout << "Failed to start workers: " << twine::to_error_string(res.first) << std::endl;
+            return false;
+        }
+    }
+
+    // Let the workers settle on their cores before measuring
+    for (int i = 0; i < iterations / 10; ++i)
+    {
+        pool->wakeup_and_wait();
+    }
+
+    twine::TimingHistogram cycle_times;
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto start_time = twine::current_rt_time();
+        pool->wakeup_and_wait();
+        cycle_times.record(twine::current_rt_time() - start_time);
+    }
+
+    auto stats = cycle_times.summary();
+    std::cout << name << " " << workers << " workers: mean: " << stats.mean.count() / 1000.0 <<
+                 " us, min: " << stats.min.count() / 1000.0 <<
+                 " us, p99: " << stats.p99.count() / 1000.0 <<
+                 " us, max: " << stats.max.count() / 1000.0 << " us" << std::endl;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<int> worker_counts(DEFAULT_WORKER_COUNTS.begin(), DEFAULT_WORKER_COUNTS.end());
+    int cores = DEFAULT_CORES;
+    int iters = DEFAULT_ITERATIONS;
+    int priority = 0;
+    int spin_time = 0;
+    bool timings = false;
+    signed char c;
+
+    while ((c = getopt(argc, argv, "w:c:i:p:s:t")) != -1)
+    {
+        switch (c)
+        {
+            case 'w':
+                worker_counts = {atoi(optarg)};
+                break;
+            case 'c':
+                cores = atoi(optarg);
+                break;
+            case 'i':
+                iters = atoi(optarg);
+                break;
+            case 'p':
+                priority = atoi(optarg);
+                break;
+            case 's':
+                spin_time = atoi(optarg);
+                break;
+            case 't':
+                timings = true;
+                break;
+            case '?':
+                std::cout << "Options are: -w[n of workers, default runs 8 and 16], -c[n of cores], -i[n of iterations], "
+                             "-p[SCHED_FIFO priority of the calling thread, 0 for none], "
+                             "-s[spin time in us before blocking, 0 for always blocking], -t[record worker timings]" << std::endl;
+                abort();
+
+            default:
+                abort();
+        }
+    }
+
+    std::cout << "Running " << iters << " cycles on " << cores << " cores" << std::endl;
+    set_rt_priority(priority);
+
+    twine::WorkerPoolOptions options;
+    options.record_timings = timings;
+    if (spin_time > 0)
+    {
+        options.wait_policy = twine::WaitPolicy::SPIN_THEN_BLOCK;
+        options.spin_time = std::chrono::microseconds(spin_time);
+    }
+
+    const std::array<std::pair<const char*, twine::BarrierType>, 3> barriers = {{{"Semaphore barrier", twine::BarrierType::MUTEX},
+                                                                                 {"Lock-free barrier", twine::BarrierType::LOCK_FREE},
+                                                                                 {"Futex barrier    ", twine::BarrierType::FUTEX}}};
+    for (auto workers : worker_counts)
+    {
+        for (const auto& [name, barrier_type] : barriers)
+        {
+            options.barrier_type = barrier_type;
+            if (run_benchmark(name, options, workers, cores, iters) == false)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
@@ -8,6 +8,7 @@
 
 #include <getopt.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 
 #ifdef TWINE_BUILD_WITH_XENOMAI
 #include "elk-warning-suppressor/warning_suppressor.hpp"
@@ -96,11 +97,29 @@ struct ProcessData
 
     int count{0};
     int id{0};
+
+    long first_cycle_page_faults{0};
+    long page_faults{0};
 };
 
+/* getrusage() is a regular linux syscall, so only count page faults when asked to */
+bool count_page_faults = false;
+
+long thread_page_faults()
+{
+#ifdef __linux__
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+#else
+    return 0;
+#endif
+}
+
 void worker_function(void* data)
 {
     auto process_data = reinterpret_cast<ProcessData*>(data);
+    long page_faults = count_page_faults ? thread_page_faults() : 0;
     auto start_time = twine::current_rt_time();
 
     int iters = MAX_LOAD;
@@ -112,9 +131,52 @@ void worker_function(void* data)
     process_data->start_time = start_time;
     process_data->end_time = twine::current_rt_time();
 
+    if (count_page_faults)
+    {
+        page_faults = thread_page_faults() - page_faults;
+        process_data->page_faults += page_faults;
+        if (process_data->count == 0)
+        {
+            process_data->first_cycle_page_faults = page_faults;
+        }
+    }
     process_data->count++;
 }
 
+/* Voices with uneven load for comparing static assignment of voices to workers with parallel_for() */
+struct VoiceData
+{
+    Buffer buffer;
+    FilterRegister mem;
+    int load{0};
+};
+
+void process_voices(int begin, int end, void* data)
+{
+    auto voices = reinterpret_cast<std::vector<VoiceData>*>(data);
+    for (int v = begin; v < end; ++v)
+    {
+        auto& voice = (*voices)[v];
+        for (int i = 0; i < voice.load; ++i)
+        {
+            process_filter(voice.buffer, voice.mem);
+        }
+    }
+}
+
+struct VoiceAssignment
+{
+    std::vector<VoiceData>* voices;
+    int begin;
+    int end;
+};
+
+void static_voice_worker_function(void* data)
+{
+    auto assignment = reinterpret_cast<VoiceAssignment*>(data);
+    process_voices(assignment->begin, assignment->end, assignment->voices);
+}
+
 #ifdef TWINE_BUILD_WITH_XENOMAI
 void xenomai_thread_init()
 {
@@ -147,9 +209,12 @@ void xenomai_thread_init()
 #endif
 
 
-std::tuple<int, int, int, bool, bool, int, double, std::string> parse_opts(int argc, char** argv)
+std::tuple<int, int, int, bool, bool, int, double, std::string, int, bool, twine::WorkerStackOptions> parse_opts(int argc, char** argv)
 {
+    twine::WorkerStackOptions stack_options;
     int workers = DEFAULT_WORKERS;
+    int voices = 0;
+    bool caller_participates = false;
     int cores = DEFAULT_CORES;
     int iters = DEFAULT_ITERATIONS;
     bool xenomai = false;
@@ -160,7 +225,7 @@ std::tuple<int, int, int, bool, bool, int, double, std::string> parse_opts(int a
     double sample_rate = 48000;
     std::string device_name = "AggregateAudio";
 
-    while ((c = getopt(argc, argv, "w:c:i:xt:b:s:d:")) != -1)
+    while ((c = getopt(argc, argv, "w:c:i:xt:b:s:d:v:pk:gf")) != -1)
     {
         switch (c)
         {
@@ -192,8 +257,29 @@ std::tuple<int, int, int, bool, bool, int, double, std::string> parse_opts(int a
             case 'd':
                 device_name = optarg;
                 break;
+            case 'v':
+                voices = atoi(optarg);
+                break;
+            case 'p':
+                caller_participates = true;
+                break;
+            case 'k':
+                stack_options.size = static_cast<size_t>(atoi(optarg)) * 1024;
+                stack_options.prefault = true;
+                stack_options.lock = true;
+                break;
+            case 'g':
+                stack_options.huge_pages = true;
+                break;
+            case 'f':
+                count_page_faults = true;
+                break;
             case '?':
-                std::cout << "Options are: -w[n of worker threads], -c[n of cores], -i[n of iterations], -x - use xenomai threads, -t - print timings for each iteration" << std::endl;
+                std::cout << "Options are: -w[n of worker threads], -c[n of cores], -i[n of iterations], -x - use xenomai threads, -t - print timings for each iteration, "
+                             "-v[n of voices] - compare static assignment of voices with uneven load to parallel_for(), "
+                             "-p - run the work of one worker in the calling thread, "
+                             "-k[stack size in kB] - prefault and lock worker stacks of this size, -g - put worker stacks on huge pages, "
+                             "-f - count page faults in worker callbacks" << std::endl;
                 abort();
 
             default:
@@ -202,7 +288,7 @@ std::tuple<int, int, int, bool, bool, int, double, std::string> parse_opts(int a
     }
     return std::make_tuple(workers, cores, iters, xenomai,
                            print_timings,
-                           chunk_size, sample_rate, device_name);
+                           chunk_size, sample_rate, device_name, voices, caller_participates, stack_options);
 }
 
 
@@ -291,6 +377,33 @@ void print_final_stats(const std::vector<ProcessData>& data)
                                             " us;\t Thread start time: avg: " << w.start.mean_time.count() / 1000.0 <<
                                             " us, min: " << w.start.min_time.count() / 1000.0 <<
                                             " us, max: " << w.start.max_time.count() / 1000.0 << "us. " << std::endl;
+        if (count_page_faults)
+        {
+            std::cout << "Worker " << i << ": Page faults: first cycle: " << w.first_cycle_page_faults <<
+                                            ", total: " << w.page_faults << std::endl;
+        }
+    }
+}
+
+void print_timing_summary(const std::string& name, const twine::TimingSummary& summary)
+{
+    std::cout << "  " << name << ": avg: " << summary.mean.count() / 1000.0 <<
+                 " us, min: " << summary.min.count() / 1000.0 <<
+                 " us, p99: " << summary.p99.count() / 1000.0 <<
+                 " us, p99.9: " << summary.p999.count() / 1000.0 <<
+                 " us, max: " << summary.max.count() / 1000.0 << " us" << std::endl;
+}
+
+void print_worker_timings(const twine::WorkerPool& pool)
+{
+    std::cout << "Timings recorded by the pool:" << std::endl;
+    auto timings = pool.worker_timings();
+    for (unsigned int i = 0; i < timings.size(); ++i)
+    {
+        std::cout << "Worker " << i << ":" << std::endl;
+        print_timing_summary("Wake latency     ", timings[i].wake_latency);
+        print_timing_summary("Callback duration", timings[i].callback_duration);
+        print_timing_summary("Completion skew  ", timings[i].completion_skew);
     }
 }
 
@@ -334,7 +447,46 @@ void* run_stress_test(void* data)
     return nullptr;
 }
 
-void run_stress_test_in_xenomai_thread([[maybe_unused]] void* data)
+struct VoiceBenchmarkData
+{
+    twine::WorkerPool* pool;
+    std::vector<VoiceData>* voices;
+    int iters;
+    TimeStats static_assignment;
+    TimeStats parallel_for;
+};
+
+void* run_voice_benchmark(void* data)
+{
+#ifdef TWINE_BUILD_WITH_EVL
+    evl_attach_self("/pool_stress_test_main");
+#endif
+    twine::set_flush_denormals_to_zero();
+    auto benchmark = reinterpret_cast<VoiceBenchmarkData*>(data);
+    auto voice_count = static_cast<int>(benchmark->voices->size());
+    for (int i = 0; i < benchmark->iters; ++i)
+    {
+        // Every worker runs its own fixed slice of voices
+        auto start_time = twine::current_rt_time();
+        benchmark->pool->wakeup_and_wait();
+        update_stats(benchmark->static_assignment, twine::current_rt_time() - start_time);
+
+        // Workers and the calling thread share the voices dynamically
+        start_time = twine::current_rt_time();
+        benchmark->pool->parallel_for(0, voice_count, 1, process_voices, benchmark->voices);
+        update_stats(benchmark->parallel_for, twine::current_rt_time() - start_time);
+    }
+    return nullptr;
+}
+
+void print_voice_stats(const std::string& name, const TimeStats& stats)
+{
+    std::cout << name << ": avg: " << stats.mean_time.count() / 1000.0 <<
+                         " us, min: " << stats.min_time.count() / 1000.0 <<
+                         " us, max: " << stats.max_time.count() / 1000.0 << " us" << std::endl;
+}
+
+void run_in_xenomai_thread([[maybe_unused]] void* (*function)(void*), [[maybe_unused]] void* data)
 {
 #ifdef TWINE_BUILD_WITH_XENOMAI
     /* Threadpool must be controlled from another xenomai thread */
@@ -348,7 +500,7 @@ void run_stress_test_in_xenomai_thread([[maybe_unused]] void* data)
     pthread_attr_setschedparam(&task_attributes, &rt_params);
     pthread_t thread;
 
-    auto res = __cobalt_pthread_create(&thread, &task_attributes, &run_stress_test, data);
+    auto res = __cobalt_pthread_create(&thread, &task_attributes, function, data);
     if (res != 0)
     {
         std::cout << "Failed to start xenomai thread: " << strerror(res) <<std::endl;
@@ -366,7 +518,7 @@ void run_stress_test_in_xenomai_thread([[maybe_unused]] void* data)
     pthread_attr_setschedparam(&task_attributes, &rt_params);
     pthread_t thread;
 
-    auto res = pthread_create(&thread, &task_attributes, &run_stress_test, data);
+    auto res = pthread_create(&thread, &task_attributes, function, data);
     if (res != 0)
     {
         std::cout << "Failed to start EVL thread: " << strerror(res) <<std::endl;
@@ -376,9 +528,56 @@ void run_stress_test_in_xenomai_thread([[maybe_unused]] void* data)
 #endif
 }
 
+int run_voice_comparison(twine::WorkerPool* pool, int workers, int voice_count, int iters, bool xenomai, std::mt19937& gen)
+{
+    std::uniform_real_distribution<float> dist(-1, 1);
+    std::uniform_int_distribution<int> load_dist(MAX_LOAD / 10, MAX_LOAD);
+
+    std::vector<VoiceData> voices(voice_count);
+    for (auto& voice : voices)
+    {
+        voice.mem = {0, 0};
+        voice.load = load_dist(gen) / 4;
+        for (auto& b : voice.buffer)
+        {
+            b = dist(gen);
+        }
+    }
+
+    // Split the voices statically and evenly by count, which is the best a host can
+    // do without knowing the load of each voice in advance
+    std::vector<VoiceAssignment> assignments(workers);
+    for (int i = 0; i < workers; ++i)
+    {
+        assignments[i] = {&voices, i * voice_count / workers, (i + 1) * voice_count / workers};
+        auto res = pool->add_worker(static_voice_worker_function, &assignments[i]);
+        if (res.first != twine::WorkerPoolStatus::OK)
+        {
+            std::cout << "Failed to start workers: " << to_error_string(res.first) << std::endl;
+            return -1;
+        }
+    }
+
+    std::cout << "Comparing static assignment with parallel_for for " << voice_count << " voices" << std::endl;
+    VoiceBenchmarkData benchmark{pool, &voices, iters, {}, {}};
+    if (xenomai)
+    {
+        run_in_xenomai_thread(run_voice_benchmark, &benchmark);
+    }
+    else
+    {
+        run_voice_benchmark(&benchmark);
+    }
+
+    std::cout << iters << " iterations" << std::endl;
+    print_voice_stats("Static assignment", benchmark.static_assignment);
+    print_voice_stats("parallel_for     ", benchmark.parallel_for);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
-    auto [workers, cores, iters, xenomai, timings, chunk_size, sample_rate, device_name] = parse_opts(argc, argv);
+    auto [workers, cores, iters, xenomai, timings, chunk_size, sample_rate, device_name, voices, caller_participates, stack_options] = parse_opts(argc, argv);
 
     std::vector<ProcessData> data;
     data.reserve(workers);
@@ -391,12 +590,20 @@ int main(int argc, char **argv)
 #endif
 
     std::cout << "Running with " << workers << " workers on " << cores << " cores" << std::endl;
-    auto worker_pool = twine::WorkerPool::create_worker_pool(cores, apple_data);
+    twine::WorkerPoolOptions options;
+    options.stack = stack_options;
+    options.record_timings = true;
+    auto worker_pool = twine::WorkerPool::create_worker_pool(cores, apple_data, true, false, options);
 
     std::random_device rd;
     std::mt19937 gen(rd());
     std::uniform_real_distribution<float> dist(-1, 1);
 
+    if (voices > 0)
+    {
+        return run_voice_comparison(worker_pool.get(), workers, voices, iters, xenomai, gen);
+    }
+
     for (int i = 0; i < workers; ++i)
     {
         ProcessData d;
@@ -408,6 +615,13 @@ int main(int argc, char **argv)
         }
 
         data.push_back(d);
+        if (caller_participates && i == workers - 1)
+        {
+            // The calling thread does the work of the last worker between waking up and waiting for the others
+            worker_pool->set_caller_callback(worker_function, &data[i]);
+            std::cout << "Running the work of worker " << i << " in the calling thread" << std::endl;
+            break;
+        }
         auto res = worker_pool->add_worker(worker_function, &data[i]);
         if (res.first != twine::WorkerPoolStatus::OK)
         {
@@ -419,7 +633,7 @@ int main(int argc, char **argv)
 
     if (xenomai)
     {
-        run_stress_test_in_xenomai_thread(&test_data);
+        run_in_xenomai_thread(run_stress_test, &test_data);
 
     }
     else
@@ -429,6 +643,7 @@ int main(int argc, char **argv)
 
     std::cout << "\n" << iters << " iterations" << std::endl;
     print_final_stats(data);
+    print_worker_timings(*worker_pool);
 
     return 0;
 }
@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "twine/twine.h"
+#include "timing_histogram.h"
+
+/*
+ * cyclictest style tool for measuring the scheduling jitter of a WorkerPool.
+ * A driver thread wakes up periodically from clock_nanosleep() on absolute
+ * times and releases the workers, which record the time from being released
+ * until they start and until they finish their callbacks. This way the
+ * latency of the pool's barrier is measured on top of the timer latency that
+ * cyclictest measures, which is recorded as well.
+ *
+ * Only the summary lines are meant for people, all lines except the histogram
+ * rows start with '#', so the output can be plotted directly with gnuplot, i.e:
+ *   twine_latency -w 4 > latency.dat
+ *   gnuplot> set logscale y; plot "latency.dat" using 1:2 with histeps title "timer", \
+ *                                 "" using 1:3 with histeps title "worker 0 start"
+ */
+
+constexpr int DEFAULT_WORKERS = 4;
+constexpr int DEFAULT_PERIOD_US = 1000;
+constexpr int DEFAULT_CYCLES = 10000;
+constexpr int DEFAULT_PRIORITY = twine::DEFAULT_SCHED_PRIORITY + 1;
+constexpr int NS_PER_S = 1'000'000'000;
+
+// Every worker writes its own histograms, keep them from sharing cache lines
+struct alignas(twine::CACHE_LINE_SIZE) WorkerLatencies
+{
+    twine::TimingHistogram start;
+    twine::TimingHistogram finish;
+    const std::atomic<int64_t>* release_time{nullptr};
+    std::chrono::nanoseconds load{0};
+};
+
+void worker_function(void* data)
+{
+    auto latencies = static_cast<WorkerLatencies*>(data);
+    auto start_time = twine::current_rt_time();
+    // Written by the driver before releasing the workers, so the barrier orders the accesses
+    auto release_time = std::chrono::nanoseconds(latencies->release_time->load(std::memory_order_relaxed));
+    latencies->start.record(start_time - release_time);
+
+    while (twine::current_rt_time() - start_time < latencies->load)
+    {
+        // Simulated processing
+    }
+    latencies->finish.record(twine::current_rt_time() - release_time);
+}
+
+bool set_rt_priority(int priority)
+{
+    if (priority > 0)
+    {
+        struct sched_param rt_params = {.sched_priority = priority};
+        auto res = pthread_setschedparam(pthread_self(), SCHED_FIFO, &rt_params);
+        if (res != 0)
+        {
+            std::cout << "# Failed to set driver thread priority: " << strerror(res) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void add_period(timespec& time, int period_us)
+{
+    time.tv_nsec += static_cast<long>(period_us) * 1000;
+    while (time.tv_nsec >= NS_PER_S)
+    {
+        time.tv_nsec -= NS_PER_S;
+        time.tv_sec++;
+    }
+}
+
+std::chrono::nanoseconds to_duration(const timespec& time)
+{
+    return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+}
+
+void print_summary(const std::string& name, const twine::TimingHistogram& histogram)
+{
+    auto stats = histogram.summary();
+    std::cout << "# " << name << ": min: " << stats.min.count() / 1000.0 <<
+                 " us, mean: " << stats.mean.count() / 1000.0 <<
+                 " us, p99: " << stats.p99.count() / 1000.0 <<
+                 " us, p99.9: " << stats.p999.count() / 1000.0 <<
+                 " us, max: " << stats.max.count() / 1000.0 << " us" << std::endl;
+}
+
+/*
+ * One row per histogram bucket that any histogram has values in, with the
+ * lower limit of the bucket in us followed by the count of every histogram.
+ */
+void print_histograms(const std::vector<const twine::TimingHistogram*>& histograms)
+{
+    for (int bucket = 0; bucket < twine::TimingHistogram::BUCKETS; ++bucket)
+    {
+        if (std::none_of(histograms.begin(), histograms.end(), [&](auto h) {return h->bucket_count(bucket) > 0;}))
+        {
+            continue;
+        }
+        std::cout << twine::TimingHistogram::bucket_lower_limit(bucket) / 1000.0;
+        for (auto histogram : histograms)
+        {
+            std::cout << " " << histogram->bucket_count(bucket);
+        }
+        std::cout << "\n";
+    }
+    std::cout << std::flush;
+}
+
+int main(int argc, char **argv)
+{
+    int workers = DEFAULT_WORKERS;
+    int cores = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    int period_us = DEFAULT_PERIOD_US;
+    int cycles = DEFAULT_CYCLES;
+    int load_us = 0;
+    int priority = DEFAULT_PRIORITY;
+    int spin_time = 0;
+    twine::BarrierType barrier_type = twine::BarrierType::MUTEX;
+    signed char c;
+
+    while ((c = getopt(argc, argv, "w:c:i:l:L:p:s:b:")) != -1)
+    {
+        switch (c)
+        {
+            case 'w':
+                workers = atoi(optarg);
+                break;
+            case 'c':
+                cores = atoi(optarg);
+                break;
+            case 'i':
+                period_us = atoi(optarg);
+                break;
+            case 'l':
+                cycles = atoi(optarg);
+                break;
+            case 'L':
+                load_us = atoi(optarg);
+                break;
+            case 'p':
+                priority = atoi(optarg);
+                break;
+            case 's':
+                spin_time = atoi(optarg);
+                break;
+            case 'b':
+                barrier_type = static_cast<twine::BarrierType>(atoi(optarg));
+                break;
+            case '?':
+                std::cout << "Options are: -w[n of workers], -c[n of cores], -i[period in us], -l[n of cycles], "
+                             "-L[load per worker and cycle in us], -p[SCHED_FIFO priority of the driver thread, 0 for none, "
+                             "workers run at " << twine::DEFAULT_SCHED_PRIORITY << "], "
+                             "-s[spin time in us before blocking, 0 for always blocking], "
+                             "-b[barrier type, 0: mutex, 1: lock-free, 2: futex]" << std::endl;
+                abort();
+
+            default:
+                abort();
+        }
+    }
+
+    if (workers < 1 || period_us < 1 || period_us >= NS_PER_S / 1000 || cycles < 1 || load_us < 0)
+    {
+        std::cout << "Invalid arguments" << std::endl;
+        return -1;
+    }
+
+    // As with cyclictest, page faults would be measured as latency
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        std::cout << "# Failed to lock memory: " << strerror(errno) << std::endl;
+    }
+    set_rt_priority(priority);
+
+    twine::WorkerPoolOptions options;
+    options.barrier_type = barrier_type;
+    options.record_timings = false;
+    if (spin_time > 0)
+    {
+        options.wait_policy = twine::WaitPolicy::SPIN_THEN_BLOCK;
+        options.spin_time = std::chrono::microseconds(spin_time);
+    }
+
+    twine::apple::AppleMultiThreadData apple_data{};
+    auto pool = twine::WorkerPool::create_worker_pool(cores, apple_data, true, false, options);
+
+    std::atomic<int64_t> release_time{0};
+    std::vector<WorkerLatencies> latencies(workers);
+    for (auto& worker : latencies)
+    {
+        worker.release_time = &release_time;
+        worker.load = std::chrono::microseconds(load_us);
+        auto res = pool->add_worker(worker_function, &worker);
+        if (res.first != twine::WorkerPoolStatus::OK)
+        {
+            std::cout << "Failed to start workers: " << twine::to_error_string(res.first) << std::endl;
+            return -1;
+        }
+    }
+
+    std::cout << "# twine_latency: " << workers << " workers on " << cores << " cores, period: " << period_us <<
+                 " us, load: " << load_us << " us, " << cycles << " cycles" << std::endl;
+
+    twine::TimingHistogram timer_latency;
+    int overruns = 0;
+    timespec next_wakeup;
+    clock_gettime(CLOCK_MONOTONIC, &next_wakeup);
+    add_period(next_wakeup, period_us);
+
+    for (int i = 0; i < cycles; ++i)
+    {
+        int res;
+        while ((res = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_wakeup, nullptr)) == EINTR);
+        if (res != 0)
+        {
+            std::cout << "clock_nanosleep failed: " << strerror(res) << std::endl;
+            return -1;
+        }
+
+        auto now = twine::current_rt_time();
+        release_time.store(now.count(), std::memory_order_relaxed);
+        timer_latency.record(now - to_duration(next_wakeup));
+        pool->wakeup_and_wait();
+
+        add_period(next_wakeup, period_us);
+        // Skip the periods missed instead of trying to catch up on them
+        auto finished = twine::current_rt_time();
+        while (to_duration(next_wakeup) < finished)
+        {
+            add_period(next_wakeup, period_us);
+            overruns++;
+        }
+    }
+    pool.reset();
+
+    std::cout << "# Missed periods: " << overruns << std::endl;
+    print_summary("Timer", timer_latency);
+    for (int i = 0; i < workers; ++i)
+    {
+        print_summary("Worker " + std::to_string(i) + " start ", latencies[i].start);
+        print_summary("Worker " + std::to_string(i) + " finish", latencies[i].finish);
+    }
+
+    std::vector<const twine::TimingHistogram*> histograms = {&timer_latency};
+    std::cout << "#\n# latency_us timer";
+    for (int i = 0; i < workers; ++i)
+    {
+        histograms.push_back(&latencies[i].start);
+        histograms.push_back(&latencies[i].finish);
+        std::cout << " worker_" << i << "_start worker_" << i << "_finish";
+    }
+    std::cout << std::endl;
+    print_histograms(histograms);
+    return 0;
+}
@@ -3,13 +3,6 @@
 #include "gtest/gtest.h"
 
 #include "twine.cpp"
-#ifndef TWINE_WINDOWS_THREADING
-#include "thread_helpers_posix.cpp"
-#endif
-
-#ifdef TWINE_BUILD_WITH_XENOMAI
-#include "thread_helpers_xenomai.cpp"
-#endif
 #include "twine_version.h"
 
 using namespace twine;
@@ -42,3 +35,20 @@ TEST (TwineTest, TestVersionAndBuildInfo)
     EXPECT_EQ(TWINE__VERSION_REV, version.revision);
     EXPECT_GT(strlen(twine::build_info()), 100u);
 }
+
+TEST (TwineTest, TestChromeTraceJson)
+{
+    std::vector<TraceRecord> records = {{std::chrono::nanoseconds(1000), TraceEvent::RELEASE, CALLER_TRACE_THREAD, 2},
+                                        {std::chrono::nanoseconds(1500), TraceEvent::CALLBACK_BEGIN, 0, 7},
+                                        {std::chrono::nanoseconds(2500), TraceEvent::CALLBACK_END, 0, 7}};
+    auto json = to_chrome_trace_json(records);
+    EXPECT_EQ(0u, json.find("{\"traceEvents\":["));
+    EXPECT_NE(std::string::npos, json.find("\"args\":{\"name\":\"Caller\"}"));
+    EXPECT_NE(std::string::npos, json.find("\"args\":{\"name\":\"Worker 0\"}"));
+    EXPECT_NE(std::string::npos, json.find("{\"name\":\"release\",\"ph\":\"i\",\"ts\":1.000,\"pid\":1,\"tid\":0,\"s\":\"t\",\"args\":{\"workers\":2}}"));
+    EXPECT_NE(std::string::npos, json.find("{\"name\":\"callback\",\"ph\":\"B\",\"ts\":1.500,\"pid\":1,\"tid\":1,\"args\":{\"cycle\":7}}"));
+    EXPECT_NE(std::string::npos, json.find("{\"name\":\"callback\",\"ph\":\"E\",\"ts\":2.500"));
+
+    /* An empty trace is still a valid document */
+    EXPECT_EQ("{\"traceEvents\":[\n],\"displayTimeUnit\":\"ns\"}\n", to_chrome_trace_json({}));
+}
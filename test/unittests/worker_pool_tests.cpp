@@ -1,7 +1,11 @@
 
+#include <cinttypes>
 #include <thread>
+#include <filesystem>
 #include <functional>
 
+#include <sys/resource.h>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -32,11 +36,12 @@ namespace
     constexpr int TEST_SAMPLE_RATE = 48000;
 }
 
-void test_function(std::atomic_bool& running, std::atomic_bool& flag, BarrierWithTrigger<ThreadType::PTHREAD>(& barrier))
+template <typename Barrier>
+void test_function(std::atomic_bool& running, std::atomic_bool& flag, Barrier& barrier, int index)
 {
     while (running)
     {
-        barrier.wait();
+        barrier.wait(index);
         flag = true;
     }
 }
@@ -56,7 +61,11 @@ TEST (UtilityFunctionTest, TestGetIsolatedCpus)
     EXPECT_EQ(3, res.at(1));
 
     res = read_isolated_cores("23");
-    EXPECT_TRUE(res.empty());
+    ASSERT_EQ(1, res.size());
+    EXPECT_EQ(23, res.at(0));
+
+    res = read_isolated_cores("2,3,6-7\n");
+    EXPECT_EQ(std::vector<int>({2, 3, 6, 7}), res);
 
     res = read_isolated_cores("");
     EXPECT_TRUE(res.empty());
@@ -74,16 +83,227 @@ TEST (UtilityFunctionTest, TestBuildCoreList)
     EXPECT_EQ(4, list.at(2).id);
 }
 
-TEST (BarrierTest, TestBarrierWithTrigger)
+TEST (UtilityFunctionTest, TestParseCpuList)
+{
+    EXPECT_EQ(std::vector<int>({0, 1, 2, 3}), parse_cpu_list("0-3"));
+    EXPECT_EQ(std::vector<int>({0, 2, 3, 7}), parse_cpu_list("0,2-3,7\n"));
+    EXPECT_EQ(std::vector<int>({23}), parse_cpu_list("23"));
+    EXPECT_TRUE(parse_cpu_list("").empty());
+    EXPECT_TRUE(parse_cpu_list("4-").empty());
+    EXPECT_TRUE(parse_cpu_list("3-1").empty());
+    EXPECT_TRUE(parse_cpu_list("1,x").empty());
+}
+
+/* Writes a fake sysfs cpu directory with 2 packages, each with 2 physical cores
+ * that have 2 SMT siblings each, so that cpu 2n and 2n + 1 share a core. Every
+ * core has its own L2 and every package has an L3 shared by its cores. */
+class CpuTopologyTest : public ::testing::Test
+{
+protected:
+    static constexpr int TEST_CPUS = 8;
+
+    void SetUp() override
+    {
+        char path_template[] = "/tmp/twine_topology_test_XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(path_template));
+        _path = path_template;
+
+        for (int cpu = 0; cpu < TEST_CPUS; ++cpu)
+        {
+            int core = cpu / 2;
+            int package = cpu / 4;
+            auto siblings = std::to_string(core * 2) + "-" + std::to_string(core * 2 + 1);
+            auto package_cpus = std::to_string(package * 4) + "-" + std::to_string(package * 4 + 3);
+            auto cpu_path = _path + "/cpu" + std::to_string(cpu);
+            _write(cpu_path + "/topology/thread_siblings_list", siblings);
+            _write(cpu_path + "/topology/physical_package_id", std::to_string(package));
+            _write_cache(cpu_path + "/cache/index0", "1", "Data", siblings);
+            _write_cache(cpu_path + "/cache/index1", "1", "Instruction", siblings);
+            _write_cache(cpu_path + "/cache/index2", "2", "Unified", siblings);
+            _write_cache(cpu_path + "/cache/index3", "3", "Unified", package_cpus);
+            std::filesystem::create_directories(cpu_path + "/node" + std::to_string(package));
+        }
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(_path);
+    }
+
+    static void _write(const std::string& path, const std::string& contents)
+    {
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+        std::ofstream file(path);
+        file << contents << std::endl;
+    }
+
+    static void _write_cache(const std::string& path, const std::string& level, const std::string& type, const std::string& cpus)
+    {
+        _write(path + "/level", level);
+        _write(path + "/type", type);
+        _write(path + "/shared_cpu_list", cpus);
+    }
+
+    std::string _path;
+};
+
+TEST_F(CpuTopologyTest, TestReadTopology)
+{
+    auto cores = build_core_list(0, TEST_CPUS + 1);
+    read_cpu_topology(_path, cores);
+
+    EXPECT_EQ(2, cores[3].core);
+    EXPECT_EQ(2, cores[3].l2_cache);
+    EXPECT_EQ(0, cores[3].l3_cache);
+    EXPECT_EQ(0, cores[3].package);
+    EXPECT_EQ(0, cores[3].numa_node);
+
+    EXPECT_EQ(4, cores[5].core);
+    EXPECT_EQ(4, cores[5].l2_cache);
+    EXPECT_EQ(4, cores[5].l3_cache);
+    EXPECT_EQ(1, cores[5].package);
+    EXPECT_EQ(1, cores[5].numa_node);
+
+    /* Missing cpus have unknown topology */
+    EXPECT_EQ(-1, cores[TEST_CPUS].core);
+    EXPECT_EQ(-1, cores[TEST_CPUS].l2_cache);
+    EXPECT_EQ(-1, cores[TEST_CPUS].numa_node);
+}
+
+TEST_F(CpuTopologyTest, TestWorkerPlacement)
+{
+    auto cores = build_core_list(0, TEST_CPUS);
+    read_cpu_topology(_path, cores);
+
+    /* Every physical core gets a worker before any SMT sibling is used */
+    std::vector<int> expected_order = {0, 2, 4, 6, 1, 3, 5, 7, 0};
+    for (auto expected_core : expected_order)
+    {
+        auto core = pick_worker_core(cores);
+        EXPECT_EQ(expected_core, core->id);
+        core->workers++;
+    }
+
+    /* Workers are kept on the package whose L3 they share */
+    cores = {{0, 0}, {4, 0}, {6, 0}, {2, 0}};
+    read_cpu_topology(_path, cores);
+    expected_order = {0, 2, 4, 6};
+    for (auto expected_core : expected_order)
+    {
+        auto core = pick_worker_core(cores);
+        EXPECT_EQ(expected_core, core->id);
+        core->workers++;
+    }
+}
+
+TEST_F(CpuTopologyTest, TestTopologyCoreList)
+{
+    /* The first cpus are SMT siblings, one cpu per physical core is used before them */
+    auto list = build_worker_core_list(2, _path, {0, 1, 2, 3, 4, 5, 6, 7});
+    ASSERT_EQ(2, list.size());
+    EXPECT_EQ(0, list.at(0).id);
+    EXPECT_EQ(2, list.at(1).id);
+    EXPECT_EQ(0, list.at(1).l3_cache);
+
+    list = build_worker_core_list(TEST_CPUS, _path, {0, 1, 2, 3, 4, 5, 6, 7});
+    std::vector<int> expected_order = {0, 2, 4, 6, 1, 3, 5, 7};
+    ASSERT_EQ(expected_order.size(), list.size());
+    for (size_t i = 0; i < expected_order.size(); ++i)
+    {
+        EXPECT_EQ(expected_order[i], list.at(i).id);
+        EXPECT_EQ(0, list.at(i).workers);
+    }
+
+    /* Cores sharing an L3 cache with the ones already chosen are preferred */
+    list = build_worker_core_list(3, _path, {0, 1, 4, 6, 2});
+    ASSERT_EQ(3, list.size());
+    EXPECT_EQ(0, list.at(0).id);
+    EXPECT_EQ(2, list.at(1).id);
+    EXPECT_EQ(4, list.at(2).id);
+
+    /* Siblings are used when there are no other cores left, before doubling up */
+    auto cores = build_worker_core_list(2, _path, {0, 1});
+    for (auto expected_core : {0, 1})
+    {
+        auto core = pick_worker_core(cores);
+        EXPECT_EQ(expected_core, core->id);
+        core->workers++;
+    }
+}
+
+TEST_F(CpuTopologyTest, TestUnknownTopologyPlacement)
+{
+    auto cores = build_core_list(0, 4);
+    read_cpu_topology(_path + "/missing", cores);
+    for (int i = 0; i < 4; ++i)
+    {
+        auto core = pick_worker_core(cores);
+        EXPECT_EQ(i, core->id);
+        core->workers++;
+    }
+}
+
+TEST_F(CpuTopologyTest, TestShieldedCoreList)
+{
+    /* Without isolated or nohz_full cpus, the allowed cpus are used */
+    auto list = build_worker_core_list(3, _path, {1, 2, 5, 6});
+    ASSERT_EQ(3, list.size());
+    EXPECT_EQ(1, list.at(0).id);
+    EXPECT_EQ(2, list.at(1).id);
+    EXPECT_EQ(5, list.at(2).id);
+
+    list = build_worker_core_list(2, _path, {});
+    ASSERT_EQ(2, list.size());
+    EXPECT_EQ(0, list.at(0).id);
+    EXPECT_EQ(1, list.at(1).id);
+
+    /* Only isolated and nohz_full cpus that are also allowed are used */
+    _write(_path + "/isolated", "2,6-7");
+    _write(_path + "/nohz_full", "5-6");
+    list = build_worker_core_list(4, _path, {1, 2, 3, 4, 5, 6});
+    ASSERT_EQ(3, list.size());
+    EXPECT_EQ(2, list.at(0).id);
+    EXPECT_EQ(5, list.at(1).id);
+    EXPECT_EQ(6, list.at(2).id);
+
+    list = build_worker_core_list(4, _path, {});
+    ASSERT_EQ(4, list.size());
+    EXPECT_EQ(7, list.at(3).id);
+
+    /* If none of them are allowed, fall back to the allowed cpus */
+    list = build_worker_core_list(4, _path, {0, 1});
+    ASSERT_EQ(2, list.size());
+    EXPECT_EQ(0, list.at(0).id);
+    EXPECT_EQ(1, list.at(1).id);
+}
+
+template <typename Barrier>
+class BarrierTest : public ::testing::Test
+{
+protected:
+    Barrier _module_under_test;
+};
+
+#ifdef TWINE_HAS_FUTEX_BARRIER
+using BarrierTypes = ::testing::Types<BarrierWithTrigger<ThreadType::PTHREAD>,
+                                      LockFreeBarrier<ThreadType::PTHREAD>,
+                                      FutexBarrier>;
+#else
+using BarrierTypes = ::testing::Types<BarrierWithTrigger<ThreadType::PTHREAD>,
+                                      LockFreeBarrier<ThreadType::PTHREAD>>;
+#endif
+TYPED_TEST_SUITE(BarrierTest, BarrierTypes);
+
+TYPED_TEST(BarrierTest, TestBarrierWithTrigger)
 {
     std::atomic_bool a = false;
     std::atomic_bool b = false;
     std::atomic_bool running = true;
 
-    BarrierWithTrigger<ThreadType::PTHREAD> module_under_test;
+    auto& module_under_test = this->_module_under_test;
     module_under_test.set_no_threads(2);
-    std::thread t1(test_function, std::ref(running), std::ref(a), std::ref(module_under_test));
-    std::thread t2(test_function, std::ref(running), std::ref(b), std::ref(module_under_test));
+    std::thread t1(test_function<TypeParam>, std::ref(running), std::ref(a), std::ref(module_under_test), 0);
+    std::thread t2(test_function<TypeParam>, std::ref(running), std::ref(b), std::ref(module_under_test), 1);
     /* threads should start in wait mode */
     module_under_test.wait_for_all();
     ASSERT_FALSE(a);
@@ -104,6 +324,293 @@ TEST (BarrierTest, TestBarrierWithTrigger)
     ASSERT_TRUE(a);
     ASSERT_TRUE(b);
 
+    /* Repeat a number of cycles to catch lost wakeups */
+    for (int i = 0; i < 1000; ++i)
+    {
+        a = false;
+        b = false;
+        module_under_test.release_and_wait();
+        ASSERT_TRUE(a);
+        ASSERT_TRUE(b);
+    }
+
+    running = false;
+    module_under_test.release_all();
+
+    t1.join();
+    t2.join();
+}
+
+struct JobRecord
+{
+    std::atomic<int>* counter;
+    int order{-1};
+};
+
+void job_function(void* data)
+{
+    auto record = reinterpret_cast<JobRecord*>(data);
+    record->order = record->counter->fetch_add(1);
+}
+
+TEST (JobGraphTest, TestAddJobs)
+{
+    JobGraph<PosixThreadHelper> module_under_test;
+    JobRecord record;
+
+    auto res = module_under_test.add_job(job_function, &record, {});
+    ASSERT_EQ(WorkerPoolStatus::OK, res.first);
+    EXPECT_EQ(0, res.second);
+
+    res = module_under_test.add_job(job_function, &record, {0});
+    ASSERT_EQ(WorkerPoolStatus::OK, res.first);
+    EXPECT_EQ(1, res.second);
+
+    /* Jobs can only depend on jobs that already exist */
+    res = module_under_test.add_job(job_function, &record, {2});
+    EXPECT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, res.first);
+    res = module_under_test.add_job(job_function, &record, {-1});
+    EXPECT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, res.first);
+    res = module_under_test.add_job(nullptr, &record, {});
+    EXPECT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, res.first);
+    EXPECT_EQ(2, module_under_test.size());
+
+    module_under_test.clear();
+    EXPECT_EQ(0, module_under_test.size());
+}
+
+TEST (JobGraphTest, TestDependencyOrder)
+{
+    JobGraph<PosixThreadHelper> module_under_test;
+    std::atomic<int> counter{0};
+    std::array<JobRecord, 5> records;
+    for (auto& r : records)
+    {
+        r.counter = &counter;
+    }
+
+    /* Diamond shape graph with an extra independent job */
+    auto a = module_under_test.add_job(job_function, &records[0], {}).second;
+    auto b = module_under_test.add_job(job_function, &records[1], {a}).second;
+    auto c = module_under_test.add_job(job_function, &records[2], {a}).second;
+    module_under_test.add_job(job_function, &records[3], {b, c});
+    module_under_test.add_job(job_function, &records[4], {});
+
+    for (int run = 0; run < 10; ++run)
+    {
+        counter = 0;
+        module_under_test.prepare();
+        std::thread t1([&]() {module_under_test.run_ready_jobs();});
+        std::thread t2([&]() {module_under_test.run_ready_jobs();});
+        module_under_test.run_ready_jobs();
+        t1.join();
+        t2.join();
+
+        ASSERT_EQ(5, counter);
+        EXPECT_LT(records[0].order, records[1].order);
+        EXPECT_LT(records[0].order, records[2].order);
+        EXPECT_LT(records[1].order, records[3].order);
+        EXPECT_LT(records[2].order, records[3].order);
+        EXPECT_GE(records[4].order, 0);
+    }
+}
+
+constexpr int TEST_RANGE_SIZE = 100;
+
+struct RangeRecord
+{
+    std::array<std::atomic<int>, TEST_RANGE_SIZE> visits{};
+    std::atomic<int> calls{0};
+};
+
+void range_function(int begin, int end, void* data)
+{
+    auto record = reinterpret_cast<RangeRecord*>(data);
+    for (int i = begin; i < end; ++i)
+    {
+        record->visits[i]++;
+    }
+    record->calls++;
+}
+
+TEST (ParallelForTest, TestSingleThread)
+{
+    ParallelFor module_under_test;
+    module_under_test.set_participants(3);
+    RangeRecord record;
+
+    /* A single thread must steal all chunks from the other deques */
+    module_under_test.prepare(10, TEST_RANGE_SIZE, 8, range_function, &record);
+    module_under_test.run_chunks(1);
+
+    EXPECT_EQ(12, record.calls);
+    for (int i = 0; i < TEST_RANGE_SIZE; ++i)
+    {
+        ASSERT_EQ(i < 10 ? 0 : 1, record.visits[i]);
+    }
+}
+
+TEST (ParallelForTest, TestConcurrentStealing)
+{
+    ParallelFor module_under_test;
+    module_under_test.set_participants(3);
+
+    for (int run = 0; run < 100; ++run)
+    {
+        RangeRecord record;
+        module_under_test.prepare(0, TEST_RANGE_SIZE, 1, range_function, &record);
+        std::thread t1([&]() {module_under_test.run_chunks(1);});
+        std::thread t2([&]() {module_under_test.run_chunks(2);});
+        module_under_test.run_chunks(0);
+        t1.join();
+        t2.join();
+
+        ASSERT_EQ(TEST_RANGE_SIZE, record.calls);
+        for (const auto& visits : record.visits)
+        {
+            ASSERT_EQ(1, visits);
+        }
+    }
+}
+
+struct RangeBounds
+{
+    int64_t indices{0};
+    int     calls{0};
+    int     last_end{std::numeric_limits<int>::min()};
+};
+
+void range_bounds_function(int begin, int end, void* data)
+{
+    auto bounds = reinterpret_cast<RangeBounds*>(data);
+    EXPECT_LT(begin, end);
+    bounds->indices += static_cast<int64_t>(end) - begin;
+    bounds->calls++;
+    bounds->last_end = std::max(bounds->last_end, end);
+}
+
+TEST (ParallelForTest, TestLargeRanges)
+{
+    ParallelFor module_under_test;
+    module_under_test.set_participants(1);
+
+    /* Chunk bounds near the end of the int range do not overflow */
+    RangeBounds bounds;
+    module_under_test.prepare(std::numeric_limits<int>::max() - 10, std::numeric_limits<int>::max(), 4, range_bounds_function, &bounds);
+    module_under_test.run_chunks(0);
+    EXPECT_EQ(10, bounds.indices);
+    EXPECT_EQ(3, bounds.calls);
+    EXPECT_EQ(std::numeric_limits<int>::max(), bounds.last_end);
+
+    /* Neither does the length of a range spanning all ints */
+    bounds = RangeBounds();
+    module_under_test.prepare(std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), 1 << 30, range_bounds_function, &bounds);
+    module_under_test.run_chunks(0);
+    EXPECT_EQ(std::numeric_limits<uint32_t>::max(), bounds.indices);
+    EXPECT_EQ(4, bounds.calls);
+    EXPECT_EQ(std::numeric_limits<int>::max(), bounds.last_end);
+}
+
+TEST (TimingHistogramTest, TestBuckets)
+{
+    for (uint64_t value : {0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull})
+    {
+        auto bucket = TimingHistogram::bucket_index(value);
+        EXPECT_LE(TimingHistogram::bucket_lower_limit(bucket), value);
+        EXPECT_GE(TimingHistogram::bucket_upper_limit(bucket), value);
+    }
+    /* Small values are exact */
+    EXPECT_EQ(10, TimingHistogram::bucket_index(10));
+    EXPECT_EQ(TimingHistogram::bucket_index(1024), TimingHistogram::bucket_index(1080));
+    EXPECT_NE(TimingHistogram::bucket_index(1024), TimingHistogram::bucket_index(1100));
+}
+
+TEST (TimingHistogramTest, TestSummary)
+{
+    TimingHistogram module_under_test;
+    auto summary = module_under_test.summary();
+    EXPECT_EQ(0, summary.count);
+    EXPECT_EQ(0, summary.max.count());
+
+    /* 1000 values of 1 us and 10 outliers of 100 us */
+    for (int i = 0; i < 1000; ++i)
+    {
+        module_under_test.record(std::chrono::microseconds(1));
+    }
+    for (int i = 0; i < 10; ++i)
+    {
+        module_under_test.record(std::chrono::microseconds(100));
+    }
+    summary = module_under_test.summary();
+    EXPECT_EQ(1010, summary.count);
+    EXPECT_EQ(1000, summary.min.count());
+    EXPECT_EQ(100000, summary.max.count());
+    EXPECT_EQ((1000 * 1000 + 10 * 100000) / 1010, summary.mean.count());
+    EXPECT_NEAR(1000, summary.p99.count(), 1000 / 16);
+    EXPECT_NEAR(100000, summary.p999.count(), 100000 / 16);
+
+    /* Negative durations are clamped */
+    module_under_test.record(std::chrono::nanoseconds(-5));
+    EXPECT_EQ(0, module_under_test.summary().min.count());
+}
+
+TYPED_TEST(BarrierTest, TestSpinThenBlockPolicy)
+{
+    std::atomic_bool a = false;
+    std::atomic_bool b = false;
+    std::atomic_bool running = true;
+
+    auto& module_under_test = this->_module_under_test;
+    module_under_test.set_wait_policy(WaitPolicy::SPIN_THEN_BLOCK, std::chrono::microseconds(5));
+    module_under_test.set_no_threads(2);
+    std::thread t1(test_function<TypeParam>, std::ref(running), std::ref(a), std::ref(module_under_test), 0);
+    std::thread t2(test_function<TypeParam>, std::ref(running), std::ref(b), std::ref(module_under_test), 1);
+    module_under_test.wait_for_all();
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        a = false;
+        b = false;
+        module_under_test.release_and_wait();
+        EXPECT_TRUE(a);
+        EXPECT_TRUE(b);
+    }
+
+    running = false;
+    module_under_test.release_all();
+
+    t1.join();
+    t2.join();
+}
+
+TYPED_TEST(BarrierTest, TestSelectiveRelease)
+{
+    std::atomic_bool a = false;
+    std::atomic_bool b = false;
+    std::atomic_bool running = true;
+
+    auto& module_under_test = this->_module_under_test;
+    module_under_test.set_no_threads(2);
+    std::thread t1(test_function<TypeParam>, std::ref(running), std::ref(a), std::ref(module_under_test), 0);
+    std::thread t2(test_function<TypeParam>, std::ref(running), std::ref(b), std::ref(module_under_test), 1);
+    module_under_test.wait_for_all();
+
+    /* Barriers that can not release a subset release all threads instead */
+    for (int i = 0; i < 100; ++i)
+    {
+        a = false;
+        b = false;
+        module_under_test.release_and_wait(0b10);
+        EXPECT_EQ(!TypeParam::SELECTIVE_RELEASE, a);
+        EXPECT_TRUE(b);
+    }
+
+    a = false;
+    b = false;
+    module_under_test.release_and_wait(0);
+    EXPECT_EQ(!TypeParam::SELECTIVE_RELEASE, a);
+    EXPECT_EQ(!TypeParam::SELECTIVE_RELEASE, b);
+
     running = false;
     module_under_test.release_all();
 
@@ -111,6 +618,41 @@ TEST (BarrierTest, TestBarrierWithTrigger)
     t2.join();
 }
 
+#ifdef TWINE_WITH_TRACING
+TEST (TraceRingTest, TestOverwrite)
+{
+    constexpr uint32_t EXTRA_RECORDS = 10;
+    TraceRing module_under_test(3);
+    std::vector<TraceRecord> records;
+    module_under_test.drain(records);
+    EXPECT_TRUE(records.empty());
+
+    /* Only the latest records are kept when the ring is full */
+    for (uint32_t i = 0; i < TRACE_RING_SIZE + EXTRA_RECORDS; ++i)
+    {
+        module_under_test.record(TraceEvent::CALLBACK_BEGIN, i);
+    }
+    module_under_test.drain(records);
+    ASSERT_EQ(TRACE_RING_SIZE - 1, records.size());
+    EXPECT_EQ(EXTRA_RECORDS + 1, records.front().value);
+    EXPECT_EQ(TRACE_RING_SIZE + EXTRA_RECORDS - 1, records.back().value);
+    EXPECT_EQ(3, records.front().thread);
+    EXPECT_EQ(TraceEvent::CALLBACK_BEGIN, records.front().event);
+    EXPECT_LE(records.front().time, records.back().time);
+
+    /* Draining only returns new records */
+    records.clear();
+    module_under_test.drain(records);
+    EXPECT_TRUE(records.empty());
+    module_under_test.record(TraceEvent::RELEASE, 5);
+    module_under_test.drain(records);
+    ASSERT_EQ(1, records.size());
+    EXPECT_EQ(TraceEvent::RELEASE, records[0].event);
+    EXPECT_EQ(5, records[0].value);
+}
+#endif
+
+template <typename PoolType>
 class PthreadWorkerPoolTest : public ::testing::Test
 {
 protected:
@@ -125,12 +667,20 @@ protected:
     {
     }
 
+    static WorkerPoolOptions timing_options()
+    {
+        WorkerPoolOptions options;
+        options.record_timings = true;
+        return options;
+    }
+
     AppleTestData _test_data;
 
-    WorkerPoolImpl<ThreadType::PTHREAD> _module_under_test {N_TEST_WORKERS,
-                                                            _test_data.apple_data,
-                                                            true,
-                                                            false};
+    PoolType _module_under_test {N_TEST_WORKERS,
+                                 _test_data.apple_data,
+                                 true,
+                                 false,
+                                 timing_options()};
 
     bool a {false};
     bool b {false};
@@ -140,64 +690,74 @@ protected:
 #endif
 };
 
+#ifdef TWINE_HAS_FUTEX_BARRIER
+using PoolTypes = ::testing::Types<WorkerPoolImpl<ThreadType::PTHREAD>,
+                                   WorkerPoolImpl<ThreadType::PTHREAD, LockFreeBarrier<ThreadType::PTHREAD>>,
+                                   WorkerPoolImpl<ThreadType::PTHREAD, FutexBarrier>>;
+#else
+using PoolTypes = ::testing::Types<WorkerPoolImpl<ThreadType::PTHREAD>,
+                                   WorkerPoolImpl<ThreadType::PTHREAD, LockFreeBarrier<ThreadType::PTHREAD>>>;
+#endif
+TYPED_TEST_SUITE(PthreadWorkerPoolTest, PoolTypes);
+
 void worker_function(void* data)
 {
     bool* flag = reinterpret_cast<bool*>(data);
     *flag = true;
 }
 
-TEST_F(PthreadWorkerPoolTest, FunctionalityTest)
+TYPED_TEST(PthreadWorkerPoolTest, FunctionalityTest)
 {
 #ifdef TWINE_APPLE_THREADING
-    _module_under_test._apple_data.chunk_size = TEST_AUDIO_CHUNK_SIZE;
-    _module_under_test._apple_data.current_sample_rate = TEST_SAMPLE_RATE;
+    this->_module_under_test._apple_data.chunk_size = TEST_AUDIO_CHUNK_SIZE;
+    this->_module_under_test._apple_data.current_sample_rate = TEST_SAMPLE_RATE;
 
 #ifdef TWINE_BUILD_WITH_APPLE_COREAUDIO
-    MockLambdas mock_lambdas(_test_data);
-    workgroup_repeated_success_expectations(_mock, mock_lambdas);
+    MockLambdas mock_lambdas(this->_test_data);
+    workgroup_repeated_success_expectations(this->_mock, mock_lambdas);
 
-    EXPECT_CALL(_mock, os_workgroup_join).WillRepeatedly(Return(0)); // 0 for success
-    EXPECT_CALL(_mock, pthread_mach_thread_np).WillRepeatedly(Return(true));
+    EXPECT_CALL(this->_mock, os_workgroup_join).WillRepeatedly(Return(0)); // 0 for success
+    EXPECT_CALL(this->_mock, pthread_mach_thread_np).WillRepeatedly(Return(true));
 #endif
 
 #endif
 
-    auto res = _module_under_test.add_worker(worker_function, &a);
+    auto res = this->_module_under_test.add_worker(worker_function, &this->a);
     ASSERT_EQ(WorkerPoolStatus::OK, res.first);
 
-    res = _module_under_test.add_worker(worker_function, &b);
+    res = this->_module_under_test.add_worker(worker_function, &this->b);
     ASSERT_EQ(WorkerPoolStatus::OK, res.first);
 
-    ASSERT_FALSE(a);
-    ASSERT_FALSE(b);
+    ASSERT_FALSE(this->a);
+    ASSERT_FALSE(this->b);
 
-    _module_under_test.wakeup_workers();
-    _module_under_test.wait_for_workers_idle();
+    this->_module_under_test.wakeup_workers();
+    this->_module_under_test.wait_for_workers_idle();
 
-    ASSERT_TRUE(a);
-    ASSERT_TRUE(b);
+    ASSERT_TRUE(this->a);
+    ASSERT_TRUE(this->b);
 }
 
 #ifndef __APPLE__
-TEST_F(PthreadWorkerPoolTest, TestSetPriority)
+TYPED_TEST(PthreadWorkerPoolTest, TestSetPriority)
 {
     constexpr int TEST_SCHED_PRIO_0 = 66;
     constexpr int TEST_SCHED_PRIO_1 = 77;
-    auto res = _module_under_test.add_worker(worker_function, nullptr, TEST_SCHED_PRIO_0);
+    auto res = this->_module_under_test.add_worker(worker_function, nullptr, TEST_SCHED_PRIO_0);
     ASSERT_EQ(WorkerPoolStatus::OK, res.first);
-    res = _module_under_test.add_worker(worker_function, nullptr, TEST_SCHED_PRIO_1);
+    res = this->_module_under_test.add_worker(worker_function, nullptr, TEST_SCHED_PRIO_1);
     ASSERT_EQ(WorkerPoolStatus::OK, res.first);
 
     pthread_attr_t task_attributes;
     struct sched_param rt_params;
-    pthread_t worker_tid = _module_under_test._workers[0]->_thread_handle;
+    pthread_t worker_tid = this->_module_under_test._workers[0]->_thread_handle;
     auto pres = pthread_getattr_np(worker_tid, &task_attributes);
     ASSERT_EQ(pres, 0);
     pres = pthread_attr_getschedparam(&task_attributes, &rt_params);
     ASSERT_EQ(pres, 0);
     ASSERT_EQ(rt_params.sched_priority, TEST_SCHED_PRIO_0);
 
-    worker_tid = _module_under_test._workers[1]->_thread_handle;
+    worker_tid = this->_module_under_test._workers[1]->_thread_handle;
     pres = pthread_getattr_np(worker_tid, &task_attributes);
     ASSERT_EQ(pres, 0);
     pres = pthread_attr_getschedparam(&task_attributes, &rt_params);
@@ -206,33 +766,33 @@ TEST_F(PthreadWorkerPoolTest, TestSetPriority)
 }
 #endif
 
-TEST_F(PthreadWorkerPoolTest, TestWrongPriority)
+TYPED_TEST(PthreadWorkerPoolTest, TestWrongPriority)
 {
 #ifdef TWINE_BUILD_WITH_APPLE_COREAUDIO
-    MockLambdas mock_lambdas(_test_data);
-    workgroup_repeated_success_expectations(_mock, mock_lambdas);
+    MockLambdas mock_lambdas(this->_test_data);
+    workgroup_repeated_success_expectations(this->_mock, mock_lambdas);
 #endif
 
-    auto res = _module_under_test.add_worker(worker_function, nullptr, -17);
+    auto res = this->_module_under_test.add_worker(worker_function, nullptr, -17);
     ASSERT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, res.first);
 
-    res = _module_under_test.add_worker(worker_function, nullptr, 102);
+    res = this->_module_under_test.add_worker(worker_function, nullptr, 102);
     ASSERT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, res.first);
 }
 
 #ifndef __APPLE__
-TEST_F(PthreadWorkerPoolTest, TestAutomaticAffinity)
+TYPED_TEST(PthreadWorkerPoolTest, TestAutomaticAffinity)
 {
     for (int i=0; i<N_TEST_WORKERS; i++)
     {
-        auto res = _module_under_test.add_worker(worker_function, nullptr);
+        auto res = this->_module_under_test.add_worker(worker_function, nullptr);
         ASSERT_EQ(WorkerPoolStatus::OK, res.first);
     }
 
     for (int i=0; i<N_TEST_WORKERS; i++)
     {
         pthread_attr_t task_attributes;
-        pthread_t worker_tid = _module_under_test._workers[i]->_thread_handle;
+        pthread_t worker_tid = this->_module_under_test._workers[i]->_thread_handle;
         auto pres = pthread_getattr_np(worker_tid, &task_attributes);
         ASSERT_EQ(pres, 0);
 
@@ -255,19 +815,19 @@ TEST_F(PthreadWorkerPoolTest, TestAutomaticAffinity)
 }
 
 
-TEST_F(PthreadWorkerPoolTest, TestManualAffinity)
+TYPED_TEST(PthreadWorkerPoolTest, TestManualAffinity)
 {
     int TEST_AFFINITIES[N_TEST_WORKERS] = {3, 2, 1, 1};
     for (int i=0; i<N_TEST_WORKERS; i++)
     {
-        auto res = _module_under_test.add_worker(worker_function, nullptr, 75, TEST_AFFINITIES[i]);
+        auto res = this->_module_under_test.add_worker(worker_function, nullptr, 75, TEST_AFFINITIES[i]);
         ASSERT_EQ(WorkerPoolStatus::OK, res.first);
     }
 
     for (int i=0; i<N_TEST_WORKERS; i++)
     {
         pthread_attr_t task_attributes;
-        pthread_t worker_tid = _module_under_test._workers[i]->_thread_handle;
+        pthread_t worker_tid = this->_module_under_test._workers[i]->_thread_handle;
         auto pres = pthread_getattr_np(worker_tid, &task_attributes);
         ASSERT_EQ(pres, 0);
 
@@ -291,9 +851,880 @@ TEST_F(PthreadWorkerPoolTest, TestManualAffinity)
 }
 #endif
 
-TEST_F(PthreadWorkerPoolTest, TestManualAffinityOutOfRange)
+TYPED_TEST(PthreadWorkerPoolTest, TestJobGraph)
+{
+    std::atomic<int> counter{0};
+    std::array<JobRecord, 4> records;
+    for (auto& r : records)
+    {
+        r.counter = &counter;
+    }
+
+    /* Without workers, the job graph is run by the calling thread */
+    auto first = this->_module_under_test.add_job(job_function, &records[0]);
+    ASSERT_EQ(WorkerPoolStatus::OK, first.first);
+    this->_module_under_test.run_job_graph();
+    EXPECT_EQ(1, counter);
+
+    auto res = this->_module_under_test.add_job(job_function, &records[1], {first.second});
+    ASSERT_EQ(WorkerPoolStatus::OK, res.first);
+    res = this->_module_under_test.add_job(job_function, &records[2], {first.second});
+    ASSERT_EQ(WorkerPoolStatus::OK, res.first);
+    res = this->_module_under_test.add_job(job_function, &records[3], {1, 2});
+    ASSERT_EQ(WorkerPoolStatus::OK, res.first);
+
+    res = this->_module_under_test.add_job(job_function, &records[3], {7});
+    ASSERT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, res.first);
+
+    auto status = this->_module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    status = this->_module_under_test.add_worker(worker_function, &this->b);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+
+    counter = 0;
+    this->_module_under_test.run_job_graph();
+    ASSERT_EQ(4, counter);
+    EXPECT_EQ(0, records[0].order);
+    EXPECT_EQ(3, records[3].order);
+
+    /* The workers' own callbacks are not run as part of the job graph */
+    EXPECT_FALSE(this->a);
+    EXPECT_FALSE(this->b);
+
+    this->_module_under_test.clear_jobs();
+    counter = 0;
+    this->_module_under_test.run_job_graph();
+    EXPECT_EQ(0, counter);
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_TRUE(this->a);
+    EXPECT_TRUE(this->b);
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestParallelFor)
+{
+    /* Without workers, the range is run by the calling thread */
+    RangeRecord record;
+    this->_module_under_test.parallel_for(0, TEST_RANGE_SIZE, 10, range_function, &record);
+    EXPECT_EQ(10, record.calls);
+
+    auto status = this->_module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    status = this->_module_under_test.add_worker(worker_function, &this->b);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+
+    for (int run = 0; run < 10; ++run)
+    {
+        RangeRecord run_record;
+        this->_module_under_test.parallel_for(0, TEST_RANGE_SIZE, 3, range_function, &run_record);
+        ASSERT_EQ(34, run_record.calls);
+        for (const auto& visits : run_record.visits)
+        {
+            ASSERT_EQ(1, visits);
+        }
+    }
+
+    /* Empty ranges are not run at all */
+    RangeRecord empty_record;
+    this->_module_under_test.parallel_for(5, 5, 1, range_function, &empty_record);
+    EXPECT_EQ(0, empty_record.calls);
+    this->_module_under_test.parallel_for(5, 1, 1, range_function, &empty_record);
+    EXPECT_EQ(0, empty_record.calls);
+
+    /* Neither are ranges with an invalid grain */
+    this->_module_under_test.parallel_for(0, TEST_RANGE_SIZE, 0, range_function, &empty_record);
+    EXPECT_EQ(0, empty_record.calls);
+
+    /* The workers' own callbacks are not run as part of the range */
+    EXPECT_FALSE(this->a);
+    EXPECT_FALSE(this->b);
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestSubsetWakeup)
+{
+    auto status = this->_module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    status = this->_module_under_test.add_worker(worker_function, &this->b);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+
+    auto wakeups = [&](int id)
+    {
+        const auto& worker = this->_module_under_test._workers[id];
+        return worker->_spin_wakeups.load() + worker->_blocking_wakeups.load();
+    };
+    /* Unselected workers are not even woken up, unless the barrier can only release all of them */
+    constexpr uint64_t UNSELECTED_WAKEUPS = decltype(this->_module_under_test._barrier)::SELECTIVE_RELEASE ? 0 : 1;
+
+    this->_module_under_test.wakeup_and_wait(0b01);
+    EXPECT_TRUE(this->a);
+    EXPECT_FALSE(this->b);
+    EXPECT_EQ(1u, wakeups(0));
+    EXPECT_EQ(UNSELECTED_WAKEUPS, wakeups(1));
+
+    this->a = false;
+    this->_module_under_test.wakeup_workers(0b10);
+    this->_module_under_test.wait_for_workers_idle();
+    EXPECT_FALSE(this->a);
+    EXPECT_TRUE(this->b);
+    EXPECT_EQ(1u + UNSELECTED_WAKEUPS, wakeups(0));
+    EXPECT_EQ(1u + UNSELECTED_WAKEUPS, wakeups(1));
+
+    /* Only the workers that ran have recorded timings */
+    auto timings = this->_module_under_test.worker_timings();
+    EXPECT_EQ(1, timings[0].callback_duration.count);
+    EXPECT_EQ(1, timings[1].callback_duration.count);
+
+    this->b = false;
+    this->_module_under_test.wakeup_and_wait(ALL_WORKERS);
+    EXPECT_TRUE(this->a);
+    EXPECT_TRUE(this->b);
+}
+
+int workers_on_cores(const std::vector<CpuInfo>& cores)
+{
+    int workers = 0;
+    for (const auto& core : cores)
+    {
+        workers += core.workers;
+    }
+    return workers;
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestRemoveWorker)
+{
+    auto status = this->_module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    status = this->_module_under_test.add_worker(worker_function, &this->b);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    EXPECT_EQ(2, workers_on_cores(this->_module_under_test.core_info()));
+
+    EXPECT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, this->_module_under_test.remove_worker(2));
+    EXPECT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, this->_module_under_test.remove_worker(-1));
+
+    ASSERT_EQ(WorkerPoolStatus::OK, this->_module_under_test.remove_worker(0));
+    EXPECT_EQ(1, workers_on_cores(this->_module_under_test.core_info()));
+    EXPECT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, this->_module_under_test.remove_worker(0));
+
+    /* The remaining worker keeps running */
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_FALSE(this->a);
+    EXPECT_TRUE(this->b);
+
+    /* A new worker reuses the free id */
+    status = this->_module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    this->b = false;
+    this->_module_under_test.wakeup_and_wait(0b01);
+    EXPECT_TRUE(this->a);
+    EXPECT_FALSE(this->b);
+
+    ASSERT_EQ(WorkerPoolStatus::OK, this->_module_under_test.remove_worker(1));
+    ASSERT_EQ(WorkerPoolStatus::OK, this->_module_under_test.remove_worker(0));
+    EXPECT_EQ(0, workers_on_cores(this->_module_under_test.core_info()));
+    this->_module_under_test.wakeup_and_wait();
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestRemoveWorkerDuringCycle)
+{
+    auto status = this->_module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    status = this->_module_under_test.add_worker(worker_function, &this->b);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+
+    /* Removing a worker finishes the outstanding cycle first */
+    this->_module_under_test.wakeup_workers();
+    ASSERT_EQ(WorkerPoolStatus::OK, this->_module_under_test.remove_worker(1));
+    EXPECT_TRUE(this->a);
+    EXPECT_TRUE(this->b);
+    EXPECT_FALSE(this->_module_under_test._cycle_pending);
+
+    auto timings = this->_module_under_test.worker_timings();
+    ASSERT_LE(1, timings.size());
+    EXPECT_EQ(1, timings[0].callback_duration.count);
+    EXPECT_EQ(1, timings[0].completion_skew.count);
+
+    this->a = false;
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_TRUE(this->a);
+    EXPECT_EQ(2, this->_module_under_test.worker_timings()[0].completion_skew.count);
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestSetWorkerCallback)
+{
+    auto status = this->_module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+
+    EXPECT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, this->_module_under_test.set_worker_callback(1, worker_function, &this->b));
+    EXPECT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, this->_module_under_test.set_worker_callback(0, nullptr, &this->b));
+
+    ASSERT_EQ(WorkerPoolStatus::OK, this->_module_under_test.set_worker_callback(0, worker_function, &this->b));
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_FALSE(this->a);
+    EXPECT_TRUE(this->b);
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestCallerCallback)
+{
+    auto status = this->_module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    this->_module_under_test.set_caller_callback(worker_function, &this->b);
+
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_TRUE(this->a);
+    EXPECT_TRUE(this->b);
+
+    /* Only wakeup_and_wait() runs the caller callback */
+    this->a = false;
+    this->b = false;
+    this->_module_under_test.wakeup_workers();
+    this->_module_under_test.wait_for_workers_idle();
+    EXPECT_TRUE(this->a);
+    EXPECT_FALSE(this->b);
+
+    this->_module_under_test.set_caller_callback(nullptr, nullptr);
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_FALSE(this->b);
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestWorkerTimings)
+{
+    constexpr int TEST_CYCLES = 10;
+    auto status = this->_module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    status = this->_module_under_test.add_worker(worker_function, &this->b);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+
+    for (int i = 0; i < TEST_CYCLES; ++i)
+    {
+        this->_module_under_test.wakeup_and_wait();
+    }
+    this->_module_under_test.wakeup_workers();
+    this->_module_under_test.wait_for_workers_idle();
+    /* Waiting again without a new cycle should not record anything */
+    this->_module_under_test.wait_for_workers_idle();
+
+    auto timings = this->_module_under_test.worker_timings();
+    ASSERT_EQ(2, timings.size());
+    for (const auto& t : timings)
+    {
+        EXPECT_EQ(TEST_CYCLES + 1, t.wake_latency.count);
+        EXPECT_EQ(TEST_CYCLES + 1, t.callback_duration.count);
+        EXPECT_EQ(TEST_CYCLES + 1, t.completion_skew.count);
+        EXPECT_LE(t.wake_latency.min, t.wake_latency.max);
+    }
+    /* One of the workers always finishes first */
+    EXPECT_EQ(0, std::min(timings[0].completion_skew.min, timings[1].completion_skew.min).count());
+
+    /* Recording is off by default, then no histograms are allocated and the summaries are empty */
+    WorkerPoolOptions options;
+    EXPECT_FALSE(options.record_timings);
+    TypeParam module_under_test(N_TEST_WORKERS, this->_test_data.apple_data, true, false, options);
+    status = module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    module_under_test.wakeup_and_wait();
+    EXPECT_EQ(nullptr, module_under_test._workers[0]->_timings);
+    timings = module_under_test.worker_timings();
+    ASSERT_EQ(1, timings.size());
+    EXPECT_EQ(0, timings[0].callback_duration.count);
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestTrace)
+{
+    constexpr int TEST_CYCLES = 10;
+    auto status = this->_module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    status = this->_module_under_test.add_worker(worker_function, &this->b);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    /* Discard the records from starting the workers */
+    std::ignore = this->_module_under_test.drain_trace();
+
+    for (int i = 0; i < TEST_CYCLES; ++i)
+    {
+        this->_module_under_test.wakeup_and_wait();
+    }
+    auto records = this->_module_under_test.drain_trace();
+
+#ifdef TWINE_WITH_TRACING
+    std::array<int, 2> callbacks = {0, 0};
+    std::array<uint32_t, 2> last_cycle = {0, 0};
+    int releases = 0;
+    for (const auto& record : records)
+    {
+        if (record.thread == CALLER_TRACE_THREAD)
+        {
+            releases += record.event == TraceEvent::RELEASE;
+            continue;
+        }
+        ASSERT_TRUE(record.thread == 0 || record.thread == 1);
+        if (record.event == TraceEvent::CALLBACK_BEGIN)
+        {
+            EXPECT_GT(record.value, last_cycle[record.thread]);
+            last_cycle[record.thread] = record.value;
+            callbacks[record.thread]++;
+        }
+    }
+    EXPECT_EQ(TEST_CYCLES, callbacks[0]);
+    EXPECT_EQ(TEST_CYCLES, callbacks[1]);
+    EXPECT_EQ(TEST_CYCLES, releases);
+    EXPECT_TRUE(std::is_sorted(records.begin(), records.end(), [](const auto& lhs, const auto& rhs) {return lhs.time < rhs.time;}));
+
+    auto json = to_chrome_trace_json(records);
+    EXPECT_NE(std::string::npos, json.find("\"Worker 1\""));
+    EXPECT_NE(std::string::npos, json.find("\"name\":\"callback\",\"ph\":\"B\""));
+#else
+    /* Compiled out */
+    EXPECT_TRUE(records.empty());
+#endif
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestWaitStatistics)
+{
+    constexpr int TEST_CYCLES = 100;
+    WorkerPoolOptions options;
+    options.wait_policy = WaitPolicy::SPIN_THEN_BLOCK;
+    options.spin_time = std::chrono::microseconds(5);
+    TypeParam module_under_test(N_TEST_WORKERS, this->_test_data.apple_data, true, false, options);
+
+    auto status = module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    status = module_under_test.add_worker(worker_function, &this->b);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+
+    for (int i = 0; i < TEST_CYCLES; ++i)
+    {
+        module_under_test.wakeup_and_wait();
+    }
+    EXPECT_TRUE(this->a);
+    EXPECT_TRUE(this->b);
+
+    /* Every wait ended either while spinning or after blocking */
+    auto stats = module_under_test.wait_statistics();
+    EXPECT_EQ(TEST_CYCLES, stats.caller_spin_wakeups + stats.caller_blocking_wakeups);
+    EXPECT_EQ(2 * TEST_CYCLES, stats.worker_spin_wakeups + stats.worker_blocking_wakeups);
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestDeadlineWorker)
+{
+    auto parameters = deadline_parameters_for_audio_period(TEST_AUDIO_CHUNK_SIZE, TEST_SAMPLE_RATE, 0.5f);
+    EXPECT_EQ(std::chrono::nanoseconds(1'333'333), parameters.period);
+    EXPECT_EQ(parameters.period, parameters.deadline);
+    EXPECT_EQ(std::chrono::nanoseconds(666'666), parameters.runtime);
+
+    auto invalid_parameters = parameters;
+    invalid_parameters.runtime = parameters.period * 2;
+    auto status = this->_module_under_test.add_deadline_worker(worker_function, &this->a, invalid_parameters);
+    EXPECT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, status.first);
+
+    status = this->_module_under_test.add_deadline_worker(worker_function, &this->a, parameters);
+    if (status.first == WorkerPoolStatus::PERMISSION_DENIED)
+    {
+        GTEST_SKIP() << "Not permitted to use SCHED_DEADLINE";
+    }
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_TRUE(this->a);
+    /* Deadline workers are not pinned to any core */
+    EXPECT_EQ(0, workers_on_cores(this->_module_under_test.core_info()));
+
+    /* Reserving the full period on more workers than there are cpus must fail admission */
+    parameters.runtime = parameters.period;
+    int admitted = 0;
+    for (int i = 0; i < static_cast<int>(get_allowed_cpus().size()) + 1; ++i)
+    {
+        status = this->_module_under_test.add_deadline_worker(worker_function, &this->b, parameters);
+        if (status.first != WorkerPoolStatus::OK)
+        {
+            break;
+        }
+        admitted++;
+    }
+    EXPECT_EQ(WorkerPoolStatus::LIMIT_EXCEEDED, status.first);
+    EXPECT_EQ(1 + admitted, this->_module_under_test._no_workers);
+
+    this->a = false;
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_TRUE(this->a);
+}
+
+struct HookData
+{
+    pthread_t start_thread;
+    pthread_t worker_thread;
+    pthread_t stop_thread;
+    int starts{0};
+    int stops{0};
+    int cycles{0};
+};
+
+void hook_start_function(void* data)
+{
+    auto hook_data = static_cast<HookData*>(data);
+    hook_data->start_thread = pthread_self();
+    hook_data->starts++;
+}
+
+void hook_stop_function(void* data)
+{
+    auto hook_data = static_cast<HookData*>(data);
+    hook_data->stop_thread = pthread_self();
+    hook_data->stops++;
+}
+
+void hook_worker_function(void* data)
+{
+    auto hook_data = static_cast<HookData*>(data);
+    hook_data->worker_thread = pthread_self();
+    hook_data->cycles++;
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestWorkerHooks)
+{
+    HookData hook_data;
+    WorkerHooks hooks{hook_start_function, hook_stop_function};
+    auto status = this->_module_under_test.add_worker(hook_worker_function, &hook_data, DEFAULT_SCHED_PRIORITY, std::nullopt, hooks);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+
+    /* on_start has run on the worker thread before add_worker() returns */
+    EXPECT_EQ(1, hook_data.starts);
+    EXPECT_EQ(0, hook_data.cycles);
+    EXPECT_TRUE(pthread_equal(this->_module_under_test._workers[0]->_thread_handle, hook_data.start_thread));
+
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_EQ(1, hook_data.cycles);
+    EXPECT_TRUE(pthread_equal(hook_data.start_thread, hook_data.worker_thread));
+    EXPECT_EQ(0, hook_data.stops);
+
+    ASSERT_EQ(WorkerPoolStatus::OK, this->_module_under_test.remove_worker(0));
+    EXPECT_EQ(1, hook_data.starts);
+    EXPECT_EQ(1, hook_data.stops);
+    EXPECT_EQ(1, hook_data.cycles);
+    EXPECT_TRUE(pthread_equal(hook_data.start_thread, hook_data.stop_thread));
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestCycleWorkerData)
+{
+    bool cycle_flags[2] = {false, false};
+    auto status = this->_module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    status = this->_module_under_test.add_worker(worker_function, &this->b);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+
+    std::array<void*, 2> cycle_data = {&cycle_flags[0], &cycle_flags[1]};
+    this->_module_under_test.wakeup_and_wait(cycle_data);
+    EXPECT_TRUE(cycle_flags[0]);
+    EXPECT_TRUE(cycle_flags[1]);
+    EXPECT_FALSE(this->a);
+    EXPECT_FALSE(this->b);
+
+    /* Workers beyond the end of the span use their own data */
+    cycle_flags[0] = false;
+    std::array<void*, 1> short_cycle_data = {&cycle_flags[0]};
+    this->_module_under_test.wakeup_workers(short_cycle_data);
+    this->_module_under_test.wait_for_workers_idle();
+    EXPECT_TRUE(cycle_flags[0]);
+    EXPECT_FALSE(this->a);
+    EXPECT_TRUE(this->b);
+
+    /* The cycle data does not carry over to the next cycle */
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_TRUE(this->a);
+}
+
+void count_function(void* data)
+{
+    (*static_cast<int*>(data))++;
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestIndependentPools)
+{
+    TypeParam second_pool(N_TEST_WORKERS, this->_test_data.apple_data, true, false);
+    int counters[2] = {0, 0};
+    auto status = this->_module_under_test.add_worker(count_function, &counters[0]);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    status = second_pool.add_worker(count_function, &counters[1]);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+
+    /* Waking up one pool must never release the workers of the other */
+    for (int i = 0; i < 10; ++i)
+    {
+        this->_module_under_test.wakeup_and_wait();
+        second_pool.wakeup_and_wait();
+        second_pool.wakeup_and_wait();
+    }
+    EXPECT_EQ(10, counters[0]);
+    EXPECT_EQ(20, counters[1]);
+
+#ifdef __linux__
+    /* The semaphores are process private and leave nothing in the file system */
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("/dev/shm", error))
+    {
+        EXPECT_NE(0u, entry.path().filename().string().rfind("sem.twine", 0));
+    }
+#endif
+}
+
+bool on_separate_cache_lines(const void* lhs, const void* rhs)
+{
+    return reinterpret_cast<uintptr_t>(lhs) / CACHE_LINE_SIZE != reinterpret_cast<uintptr_t>(rhs) / CACHE_LINE_SIZE;
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestWorkerLayout)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        auto status = this->_module_under_test.add_worker(worker_function, &this->a);
+        ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    }
+    auto& workers = this->_module_under_test._workers;
+    auto& first = *workers[0];
+    auto& second = *workers[1];
+
+    /* Workers are contiguous but never share a cache line */
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&first) % CACHE_LINE_SIZE);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&second) % CACHE_LINE_SIZE);
+    EXPECT_TRUE(on_separate_cache_lines(&first._completion_time, &second));
+
+    /* Fields written by the worker every cycle are kept apart from those written by the
+     * calling thread, and from the state of the barrier and the pool */
+    EXPECT_TRUE(on_separate_cache_lines(&first._spin_wakeups, &first._thread_running));
+    EXPECT_TRUE(on_separate_cache_lines(&first._completion_time, &first._pending_callback));
+    EXPECT_TRUE(on_separate_cache_lines(&first._timings->callback_duration, &first._timings->completion_skew));
+    EXPECT_TRUE(on_separate_cache_lines(&this->_module_under_test._cycle, &this->_module_under_test._running));
+    EXPECT_TRUE(on_separate_cache_lines(&this->_module_under_test._barrier._no_threads_currently_on_barrier,
+                                        &this->_module_under_test._barrier._no_threads));
+}
+
+void context_worker_function(void* data)
+{
+    auto context = current_worker_context();
+    if (context)
+    {
+        *static_cast<WorkerContext*>(data) = *context;
+    }
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestWorkerContext)
+{
+    EXPECT_EQ(nullptr, current_worker_context());
+
+    WorkerContext contexts[2];
+    for (auto& context : contexts)
+    {
+        auto status = this->_module_under_test.add_worker(context_worker_function, &context);
+        ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    }
+
+    auto deadline = current_rt_time() + std::chrono::milliseconds(1);
+    this->_module_under_test.set_cycle_deadline(deadline);
+    auto release_time = current_rt_time();
+    this->_module_under_test.wakeup_and_wait();
+    for (int i = 0; i < 2; ++i)
+    {
+        EXPECT_EQ(i, contexts[i].worker_index);
+        EXPECT_EQ(1u, contexts[i].cycle);
+        EXPECT_GE(contexts[i].release_time, release_time);
+        EXPECT_EQ(deadline, contexts[i].deadline);
+    }
+
+    /* The deadline only applies to one cycle */
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_EQ(2u, contexts[0].cycle);
+    EXPECT_EQ(std::chrono::nanoseconds(0), contexts[0].deadline);
+
+    /* Workers that are not woken up keep the context of their last cycle */
+    this->_module_under_test.wakeup_and_wait(0b10);
+    EXPECT_EQ(2u, contexts[0].cycle);
+    EXPECT_EQ(3u, contexts[1].cycle);
+}
+
+void abort_worker_function(void* data)
+{
+    *static_cast<bool*>(data) = should_abort();
+}
+
+void cancellable_worker_function(void* data)
+{
+    while (should_abort() == false)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    *static_cast<bool*>(data) = true;
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestDeadlineOverruns)
+{
+    EXPECT_FALSE(should_abort());
+
+    bool aborted[2] = {true, true};
+    for (auto& flag : aborted)
+    {
+        auto status = this->_module_under_test.add_worker(abort_worker_function, &flag);
+        ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    }
+
+    /* Without a deadline there is nothing to abort or overrun */
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_FALSE(aborted[0]);
+    EXPECT_FALSE(aborted[1]);
+    EXPECT_EQ(std::vector<uint64_t>({0, 0}), this->_module_under_test.worker_overruns());
+
+    auto cond_var = RtConditionVariable::create_rt_condition_variable();
+    this->_module_under_test.set_overrun_notification(cond_var.get(), std::chrono::nanoseconds(0));
+    this->_module_under_test.set_cycle_deadline(current_rt_time() - std::chrono::milliseconds(1));
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_TRUE(aborted[0]);
+    EXPECT_TRUE(aborted[1]);
+    EXPECT_EQ(std::vector<uint64_t>({1, 1}), this->_module_under_test.worker_overruns());
+    EXPECT_TRUE(cond_var->wait());
+
+    this->_module_under_test.set_cycle_deadline(current_rt_time() + std::chrono::seconds(10));
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_FALSE(aborted[0]);
+    EXPECT_FALSE(aborted[1]);
+    EXPECT_EQ(std::vector<uint64_t>({1, 1}), this->_module_under_test.worker_overruns());
+    this->_module_under_test.set_overrun_notification(nullptr, std::chrono::nanoseconds(0));
+
+    /* A cancelled worker sees should_abort() return true until the cycle is finished */
+    aborted[0] = false;
+    ASSERT_EQ(WorkerPoolStatus::OK, this->_module_under_test.set_worker_callback(0, cancellable_worker_function, &aborted[0]));
+    this->_module_under_test.wakeup_workers(0b01);
+    EXPECT_EQ(WaitResult::TIMED_OUT, this->_module_under_test.wait_until(current_rt_time() + std::chrono::milliseconds(5)));
+    this->_module_under_test.cancel_cycle();
+    this->_module_under_test.wait_for_workers_idle();
+    EXPECT_TRUE(aborted[0]);
+
+    /* Cancelling only applies to the cycle that was running */
+    ASSERT_EQ(WorkerPoolStatus::OK, this->_module_under_test.set_worker_callback(0, abort_worker_function, &aborted[0]));
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_FALSE(aborted[0]);
+    EXPECT_EQ(std::vector<uint64_t>({1, 1}), this->_module_under_test.worker_overruns());
+}
+
+void blocking_worker_function(void* data)
+{
+    auto release = static_cast<std::atomic_bool*>(data);
+    while (release->load() == false)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestTimedWait)
+{
+    std::atomic_bool release = false;
+    auto status = this->_module_under_test.add_worker(worker_function, &this->a);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    status = this->_module_under_test.add_worker(blocking_worker_function, &release);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+
+    EXPECT_TRUE(this->_module_under_test.is_idle());
+    EXPECT_EQ(0u, this->_module_under_test.running_workers());
+    EXPECT_TRUE(this->_module_under_test.try_wait());
+
+    /* Polls are not counted as waits, timed waits are counted once they end with idle workers */
+    auto caller_wakeups = [&]()
+    {
+        auto stats = this->_module_under_test.wait_statistics();
+        return std::make_pair(stats.caller_spin_wakeups, stats.caller_blocking_wakeups);
+    };
+    auto wakeups = caller_wakeups();
+
+    /* The second worker overruns */
+    this->_module_under_test.wakeup_workers();
+    EXPECT_FALSE(this->_module_under_test.is_idle());
+    EXPECT_FALSE(this->_module_under_test.try_wait());
+    auto deadline = current_rt_time() + std::chrono::milliseconds(5);
+    EXPECT_EQ(WaitResult::TIMED_OUT, this->_module_under_test.wait_until(deadline));
+    EXPECT_GE(current_rt_time(), deadline);
+    EXPECT_TRUE(this->a);
+    EXPECT_EQ(0b10u, this->_module_under_test.running_workers());
+    EXPECT_EQ(wakeups, caller_wakeups());
+
+    release = true;
+    EXPECT_EQ(WaitResult::IDLE, this->_module_under_test.wait_until(current_rt_time() + std::chrono::seconds(5)));
+    EXPECT_TRUE(this->_module_under_test.is_idle());
+    EXPECT_EQ(0u, this->_module_under_test.running_workers());
+    auto new_wakeups = caller_wakeups();
+    EXPECT_EQ(wakeups.first + wakeups.second + 1, new_wakeups.first + new_wakeups.second);
+    wakeups = new_wakeups;
+
+    /* Polling until the workers are done */
+    this->a = false;
+    this->_module_under_test.wakeup_workers();
+    int polls = 0;
+    while (this->_module_under_test.try_wait() == false && polls++ < 10000)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    EXPECT_TRUE(this->a);
+    EXPECT_EQ(wakeups, caller_wakeups());
+
+    /* A deadline that has already passed still reports idle workers */
+    this->_module_under_test.wakeup_workers();
+    while (this->_module_under_test.is_idle() == false)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    EXPECT_EQ(WaitResult::IDLE, this->_module_under_test.wait_until(std::chrono::nanoseconds(0)));
+    EXPECT_EQ(std::make_pair(wakeups.first + 1, wakeups.second), caller_wakeups());
+
+    /* Workers that were not woken up are not running */
+    release = false;
+    this->_module_under_test.wakeup_workers(0b10);
+    EXPECT_EQ(WaitResult::TIMED_OUT, this->_module_under_test.wait_until(current_rt_time() + std::chrono::milliseconds(1)));
+    EXPECT_EQ(0b10u, this->_module_under_test.running_workers());
+    release = true;
+    this->_module_under_test.wait_for_workers_idle();
+}
+
+/* Double buffered data, every worker writes twice the input to its own output */
+struct PipelineData
+{
+    std::array<int, PIPELINE_SLOTS> input;
+    std::array<std::array<int, 2>, PIPELINE_SLOTS> output;
+};
+
+void pipeline_worker_function(void* data)
+{
+    auto pipeline = static_cast<PipelineData*>(data);
+    auto context = current_worker_context();
+    pipeline->output[context->slot][context->worker_index] = 2 * pipeline->input[context->slot];
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestPipelinedMode)
+{
+    constexpr int TEST_CYCLES = 10;
+    PipelineData data{};
+    for (int i = 0; i < 2; ++i)
+    {
+        auto status = this->_module_under_test.add_worker(pipeline_worker_function, &data);
+        ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    }
+    EXPECT_EQ(-1, this->_module_under_test.finish_pipeline());
+
+    /* The calling thread owns slot 0 to begin with */
+    int slot = 0;
+    data.input[slot] = 0;
+    for (int i = 1; i <= TEST_CYCLES; ++i)
+    {
+        int next_slot = this->_module_under_test.wakeup_pipelined();
+        ASSERT_NE(slot, next_slot);
+        slot = next_slot;
+        /* The output of the previous cycle is ready, one cycle later */
+        if (i > 1)
+        {
+            EXPECT_EQ(2 * (i - 2), data.output[slot][0]);
+            EXPECT_EQ(2 * (i - 2), data.output[slot][1]);
+        }
+        data.input[slot] = i;
+    }
+
+    /* The output of the last cycle is available after finishing the pipeline */
+    slot = this->_module_under_test.finish_pipeline();
+    ASSERT_NE(-1, slot);
+    EXPECT_EQ(2 * (TEST_CYCLES - 1), data.output[slot][0]);
+    EXPECT_EQ(2 * (TEST_CYCLES - 1), data.output[slot][1]);
+    EXPECT_EQ(-1, this->_module_under_test.finish_pipeline());
+
+    /* Regular cycles run on slot 0 */
+    data.input[0] = 100;
+    this->_module_under_test.wakeup_and_wait();
+    EXPECT_EQ(200, data.output[0][0]);
+    EXPECT_EQ(200, data.output[0][1]);
+
+    /* A new pipeline starts with the calling thread owning slot 0 again */
+    EXPECT_EQ(1, this->_module_under_test.wakeup_pipelined());
+    EXPECT_EQ(0, this->_module_under_test.finish_pipeline());
+}
+
+constexpr size_t TEST_STACK_SIZE = 512 * 1024;
+constexpr size_t TEST_STACK_USAGE = 256 * 1024;
+
+/* Uses a large part of the stack and counts the page faults that causes */
+void stack_usage_function(void* data)
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    auto faults = usage.ru_minflt + usage.ru_majflt;
+    auto memory = static_cast<volatile unsigned char*>(alloca(TEST_STACK_USAGE));
+    for (size_t i = 0; i < TEST_STACK_USAGE; i += 1024)
+    {
+        memory[i] = 1;
+    }
+    getrusage(RUSAGE_THREAD, &usage);
+    *static_cast<long*>(data) = usage.ru_minflt + usage.ru_majflt - faults;
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestPrefaultedStack)
+{
+    WorkerPoolOptions options;
+    options.stack.size = TEST_STACK_SIZE;
+    options.stack.prefault = true;
+    options.stack.lock = true;
+    TypeParam module_under_test(N_TEST_WORKERS, this->_test_data.apple_data, true, false, options);
+
+    long page_faults = -1;
+    auto status = module_under_test.add_worker(stack_usage_function, &page_faults);
+    if (status.first == WorkerPoolStatus::PERMISSION_DENIED || status.first == WorkerPoolStatus::LIMIT_EXCEEDED)
+    {
+        GTEST_SKIP() << "Not permitted to lock worker stacks";
+    }
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+
+    pthread_attr_t attributes;
+    ASSERT_EQ(0, pthread_getattr_np(module_under_test._workers[0]->_thread_handle, &attributes));
+    size_t stack_size = 0;
+    pthread_attr_getstacksize(&attributes, &stack_size);
+    pthread_attr_destroy(&attributes);
+    EXPECT_EQ(TEST_STACK_SIZE, stack_size);
+
+    module_under_test.wakeup_and_wait();
+    EXPECT_EQ(0, page_faults);
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestHugePageStack)
+{
+    WorkerPoolOptions options;
+    options.stack.size = TEST_STACK_SIZE;
+    options.stack.huge_pages = true;
+    options.stack.prefault = true;
+    TypeParam module_under_test(N_TEST_WORKERS, this->_test_data.apple_data, true, false, options);
+
+    long page_faults = -1;
+    auto status = module_under_test.add_worker(stack_usage_function, &page_faults);
+    ASSERT_EQ(WorkerPoolStatus::OK, status.first);
+    /* The stack is rounded up to whole huge pages */
+    const auto& worker = module_under_test._workers[0];
+    EXPECT_EQ(HUGE_PAGE_SIZE, worker->_stack_size);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(worker->_stack) % HUGE_PAGE_SIZE);
+
+    /* The page below the stack is an inaccessible guard page */
+    auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    auto guard_page = reinterpret_cast<uintptr_t>(worker->_stack) - page_size;
+    EXPECT_GE(guard_page, reinterpret_cast<uintptr_t>(worker->_stack_mapping));
+    std::ifstream maps("/proc/self/maps");
+    bool guarded = false;
+    for (std::string line; std::getline(maps, line);)
+    {
+        uintptr_t begin;
+        uintptr_t end;
+        char permissions[5] = {};
+        if (sscanf(line.c_str(), "%" SCNxPTR "-%" SCNxPTR " %4s", &begin, &end, permissions) == 3 &&
+            begin <= guard_page && guard_page < end)
+        {
+            guarded = std::string(permissions) == "---p";
+        }
+    }
+    EXPECT_TRUE(guarded);
+
+    module_under_test.wakeup_and_wait();
+    EXPECT_EQ(0, page_faults);
+    EXPECT_EQ(WorkerPoolStatus::OK, module_under_test.remove_worker(0));
+}
+
+TYPED_TEST(PthreadWorkerPoolTest, TestManualAffinityOutOfRange)
 {
-    auto res = _module_under_test.add_worker(worker_function, nullptr, 75, N_TEST_WORKERS+1);
+    auto res = this->_module_under_test.add_worker(worker_function, nullptr, 75, N_TEST_WORKERS+1);
     ASSERT_EQ(WorkerPoolStatus::INVALID_ARGUMENTS, res.first);
 }
 